@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <lang/bytecode.hpp>
+#include <lang/dlex.hpp>
+#include <lang/parser.hpp>
+#include <lang/pool.hpp>
+#include <lang/scan.hpp>
+#include <lang/source.hpp>
+#include <lang/vm.hpp>
+
+#include "corpus.hpp"
+
+// every global allocation is counted, so a run can report allocations per token
+static std::atomic<std::size_t> allocations = 0;
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    std::size_t a = (std::size_t)align;
+    if (void* p = std::aligned_alloc(a, (size + a - 1) / a * a)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new[](std::size_t size, std::align_val_t align) { return operator new(size, align); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+// peak resident set of the process so far, in KiB
+static long peak_rss_kb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static bool match(const char* arg, const char* to) { return std::strcmp(arg, to) == 0; }
+
+// 16M, 512k, 1024
+static std::size_t parse_size(const char* text) {
+    char* end;
+    std::size_t n = std::strtoull(text, &end, 10);
+    switch (*end | 0x20) {
+        case 'k': return n << 10;
+        case 'm': return n << 20;
+        case 'g': return n << 30;
+        default: return n;
+    }
+}
+
+struct Options {
+    std::size_t size = 8 << 20;
+    std::uint64_t seed = 1;
+    int reps = 5, warmup = 1, jobs = 1;
+    const char* out = nullptr;   // json goes to stdout without it
+    const char* write = nullptr; // directory to dump the corpora into
+    bool vm = false;             // the vm programs instead of the corpora
+    std::vector<Shape> shapes;
+};
+
+struct Result {
+    Shape shape;
+    std::size_t files, bytes, tokens, nodes;
+    double best_ms, median_ms;
+    double parse_best_ms, parse_median_ms;
+    double relex_median_us; // a short insertion in the middle of the first file, and its undo
+    bool relex_matches; // the edited output is what a full tokenize of the edited text gives
+    double ast_bytes_per_token; // nodes and lists, used bytes
+    double allocs_per_token;
+    long peak_rss_kb;
+};
+
+static void write_corpus(const Corpus& corpus, const char* dir) {
+    for (std::size_t i = 0; i < corpus.files.size(); i++) {
+        std::string path = std::string(dir) + "/" + shape_name(corpus.shape);
+        if (corpus.files.size() > 1) path += "_" + std::to_string(i);
+        path += ".dyt";
+        if (std::FILE* f = std::fopen(path.c_str(), "wb")) {
+            std::fwrite(corpus.files[i].data(), 1, corpus.files[i].size(), f);
+            std::fclose(f);
+        } else {
+            std::fprintf(stderr, "can't write %s\n", path.c_str());
+        }
+    }
+}
+
+// whether two outputs hold the same tokens, payloads, files and reports.
+// symbol ids may differ, their names may not
+static bool same_lex(const LexOutput& a, const LexOutput& b) {
+    if (a.count() != b.count() || a.files().size() != b.files().size()) return false;
+    for (std::size_t f = 0; f < a.files().size(); f++) {
+        if (a.files()[f].begin != b.files()[f].begin || a.files()[f].end != b.files()[f].end) return false;
+    }
+    for (std::size_t i = 0; i < a.count(); i++) {
+        Token x = a.tokens()[i], y = b.tokens()[i];
+        if (x.code() != y.code() || a.offset(i) != b.offset(i)) return false;
+        std::uint32_t u = x.value<std::uint32_t>(), v = y.value<std::uint32_t>();
+        switch (x.code()) {
+            case TokenCode::IDENTITY: if (!(a.symbols().name(u) == b.symbols().name(v))) return false; break;
+            case TokenCode::STRING: if (!(a.string(u) == b.string(v))) return false; break;
+            case TokenCode::INT: if (a.integer(u) != b.integer(v)) return false; break;
+            case TokenCode::FLOAT: if (a.number(u) != b.number(v)) return false; break;
+            default: if (u != v) return false;
+        }
+    }
+    if (a.diagnostics().size() != b.diagnostics().size()) return false;
+    for (std::size_t i = 0; i < a.diagnostics().size(); i++) {
+        const Diagnostic& x = a.diagnostics()[i];
+        const Diagnostic& y = b.diagnostics()[i];
+        if (x.code != y.code || x.file != y.file || x.offset != y.offset || x.args[0] != y.args[0] || x.args[1] != y.args[1]) return false;
+    }
+    return true;
+}
+
+// the lexer and the parser on one corpus, warmup runs first, then reps timed ones
+static Result run(const Corpus& corpus, const Options& opt) {
+    std::vector<SourceBuffer> sources;
+    for (const std::string& file : corpus.files) sources.push_back(SourceBuffer::copy(file.data(), file.size()));
+
+    for (int i = 0; i < opt.warmup; i++) {
+        LexOutput out = tokenize(sources.data(), sources.size(), 0, opt.jobs);
+        parse(out, out.diagnostics());
+    }
+
+    std::vector<double> times, parse_times;
+    std::size_t tokens = 0, nodes = 0, ast_bytes = 0, allocs = 0;
+    for (int i = 0; i < opt.reps; i++) {
+        std::size_t allocs_before = allocations.load();
+        auto begin = std::chrono::steady_clock::now();
+        LexOutput out = tokenize(sources.data(), sources.size(), 0, opt.jobs);
+        auto lexed = std::chrono::steady_clock::now();
+        Ast ast = parse(out, out.diagnostics());
+        auto end = std::chrono::steady_clock::now();
+        allocs = allocations.load() - allocs_before;
+        tokens = out.count();
+        nodes = ast.size();
+        ast_bytes = 0;
+        for (const PoolUsage& u : ast.pool_usage()) ast_bytes += u.used;
+        times.push_back(std::chrono::duration<double, std::milli>(lexed - begin).count());
+        parse_times.push_back(std::chrono::duration<double, std::milli>(end - lexed).count());
+    }
+    std::sort(times.begin(), times.end());
+    std::sort(parse_times.begin(), parse_times.end());
+
+    // the texts are made up front, only relex is timed
+    std::vector<double> relex_times;
+    bool relex_matches = true;
+    {
+        LexOutput out = tokenize(sources.data(), sources.size(), 0, opt.jobs);
+        const std::string& text = corpus.files[0];
+        std::uint32_t at = (std::uint32_t)(text.find('\n', text.size() / 2) + 1);
+        if (at == 0 || at > text.size()) at = (std::uint32_t)text.size();
+        const char insert[] = "edit = 1;\n";
+        std::uint32_t len = sizeof(insert) - 1;
+        std::string edited = text.substr(0, at) + insert + text.substr(at);
+        SourceBuffer edited_source = SourceBuffer::copy(edited.data(), edited.size());
+
+        for (int i = 0; i < opt.reps; i++) {
+            auto begin = std::chrono::steady_clock::now();
+            relex(out, 0, edited_source, { at, at, at + len });
+            relex(out, 0, sources[0], { at, at + len, at });
+            auto end = std::chrono::steady_clock::now();
+            relex_times.push_back(std::chrono::duration<double, std::micro>(end - begin).count() / 2);
+        }
+        std::sort(relex_times.begin(), relex_times.end());
+
+        // checked apart from the timing, against the whole edited corpus lexed again
+        relex(out, 0, edited_source, { at, at, at + len });
+        std::vector<SourceBuffer> edited_sources;
+        edited_sources.push_back(SourceBuffer::copy(edited.data(), edited.size()));
+        for (std::size_t i = 1; i < corpus.files.size(); i++) edited_sources.push_back(SourceBuffer::copy(corpus.files[i].data(), corpus.files[i].size()));
+        relex_matches = same_lex(out, tokenize(edited_sources.data(), edited_sources.size(), 0, opt.jobs));
+        if (!relex_matches) std::fprintf(stderr, "%s: relex differs from tokenize\n", shape_name(corpus.shape));
+    }
+
+    return {
+        corpus.shape, corpus.files.size(), corpus.bytes(), tokens, nodes,
+        times.front(), times[times.size() / 2],
+        parse_times.front(), parse_times[parse_times.size() / 2],
+        relex_times[relex_times.size() / 2], relex_matches,
+        tokens ? (double)ast_bytes / tokens : 0,
+        tokens ? (double)allocs / tokens : 0,
+        peak_rss_kb(),
+    };
+}
+
+// programs for the vm, each leaves its answer in the global result
+struct VmProgram {
+    const char* name;
+    const char* source;
+};
+
+static const VmProgram vm_programs[] = {
+    { "fib_recursive",
+        "func fib (n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }\n"
+        "result = fib(30);\n" },
+    // test/fibonacci.dyt, called over and over
+    { "fib_iterative",
+        "func (number) fibonacci (number index) {\n"
+        "    a = number(1), b = number(1);\n"
+        "    for (i = 1, index) { c = a + b; b = a; a = c; }\n"
+        "    return a;\n"
+        "}\n"
+        "func run () { s = 0; for (k = 1, 100000) s = s + fibonacci(80); return s; }\n"
+        "result = run();\n" },
+    { "numeric_loop",
+        "func run () { s = 0; for (i = 1, 20000000) { s = s + i * 3; if (s > 1000000000) s = s - 1000000000; } return s; }\n"
+        "result = run();\n" },
+    { "while_float",
+        "func run () { x = 0.0, i = 0; while (i < 10000000) { x = x + 0.5 * 2.0; i = i + 1; } return x; }\n"
+        "result = run();\n" },
+};
+
+struct VmResult {
+    const char* name;
+    std::size_t instructions; // compiled, not run
+    double best_ms, median_ms;
+    std::string result;
+};
+
+static bool run_vm(const Options& opt, std::vector<VmResult>& results) {
+    for (const VmProgram& program : vm_programs) {
+        SourceBuffer source = SourceBuffer::copy(program.source, std::strlen(program.source));
+        LexOutput lex = tokenize(&source, 1);
+        Ast ast = parse(lex, lex.diagnostics());
+        Bytecode bytecode;
+        if (!lex.diagnostics().empty() || !compile_bytecode(bytecode, ast, lex, lex.diagnostics())) {
+            std::fprintf(stderr, "%s doesn't compile\n", program.name);
+            return false;
+        }
+        std::size_t instructions = 0;
+        for (const Function& fn : bytecode.functions) instructions += fn.code.size();
+
+        std::vector<double> times;
+        std::string answer;
+        for (int i = 0; i < opt.warmup + opt.reps; i++) {
+            std::ostringstream text;
+            VM vm(bytecode, lex, lex.diagnostics(), text);
+            auto begin = std::chrono::steady_clock::now();
+            bool ok = vm.run();
+            auto end = std::chrono::steady_clock::now();
+            if (!ok) {
+                std::fprintf(stderr, "%s failed\n", program.name);
+                return false;
+            }
+            if (i >= opt.warmup) times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+            vm.print(text, vm.global("result"));
+            answer = text.str();
+        }
+        std::sort(times.begin(), times.end());
+        results.push_back({ program.name, instructions, times.front(), times[times.size() / 2], answer });
+    }
+    return true;
+}
+
+static void report_vm(std::FILE* f, const Options& opt, const std::vector<VmResult>& results) {
+    std::fprintf(f, "{\n  \"bench\": \"vm\",\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"results\": [", opt.warmup, opt.reps);
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const VmResult& r = results[i];
+        std::fprintf(f, "%s\n    {\"program\": \"%s\", \"instructions\": %zu, \"best_ms\": %.3f, \"median_ms\": %.3f, \"result\": \"%s\"}",
+            i ? "," : "", r.name, r.instructions, r.best_ms, r.median_ms, r.result.c_str());
+    }
+    std::fprintf(f, "\n  ]\n}\n");
+}
+
+static const char* level_name(scan::Level level) {
+    switch (level) {
+        case scan::Level::AVX2: return "avx2";
+        case scan::Level::SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+static void report(std::FILE* f, const Options& opt, const std::vector<Result>& results) {
+    std::fprintf(f, "{\n  \"bench\": \"lex+parse\",\n  \"simd\": \"%s\",\n  \"jobs\": %d,\n  \"block_cache\": %s,\n",
+        level_name(scan::level()), opt.jobs, block_cache::enabled() ? "true" : "false");
+    std::fprintf(f, "  \"size\": %zu,\n  \"seed\": %llu,\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"results\": [",
+        opt.size, (unsigned long long)opt.seed, opt.warmup, opt.reps);
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double seconds = r.best_ms / 1000;
+        std::fprintf(f, "%s\n    {\"shape\": \"%s\", \"files\": %zu, \"bytes\": %zu, \"tokens\": %zu, "
+            "\"best_ms\": %.3f, \"median_ms\": %.3f, \"mb_per_s\": %.1f, \"tokens_per_s\": %.0f, "
+            "\"nodes\": %zu, \"parse_best_ms\": %.3f, \"parse_median_ms\": %.3f, \"parse_tokens_per_s\": %.0f, "
+            "\"relex_median_us\": %.1f, \"ast_bytes_per_token\": %.2f, \"allocs_per_token\": %.6f, \"peak_rss_kb\": %ld}",
+            i ? "," : "", shape_name(r.shape), r.files, r.bytes, r.tokens,
+            r.best_ms, r.median_ms, r.bytes / seconds / 1e6, r.tokens / seconds,
+            r.nodes, r.parse_best_ms, r.parse_median_ms, r.tokens / (r.parse_best_ms / 1000),
+            r.relex_median_us, r.ast_bytes_per_token, r.allocs_per_token, r.peak_rss_kb);
+    }
+    std::fprintf(f, "\n  ]\n}\n");
+}
+
+// flags:
+// [-size N]: bytes per corpus, k/m/g suffixes allowed (default 8m)
+// [-shape NAME]: mixed, ident, number, comment, nested, small_files or deep, repeatable (default all)
+// [-seed N]: corpus seed
+// [-reps N] [-warmup N]: timed and untimed runs per corpus
+// [-j N]: lexer jobs (0 for every core)
+// [-nosimd]: forces the scalar scanner
+// [-cache]: enables the pool block cache
+// [-out FILE]: writes the json there instead of stdout
+// [-write DIR]: also dumps every corpus as .dyt files
+// [-vm]: times the vm on fibonacci and numeric loops instead
+int main(int count, const char** args) {
+    Options opt;
+
+    --count; ++args;
+    while (count--) {
+        const char* arg = *(args++);
+        // flags taking a value read the next argument
+        const char* value = count ? *args : nullptr;
+        auto take = [&] { --count; ++args; return value; };
+
+        if (match(arg, "-nosimd")) { scan::select(scan::Level::SCALAR); continue; }
+        if (match(arg, "-cache")) { block_cache::enable(); continue; }
+        if (match(arg, "-vm")) { opt.vm = true; continue; }
+        if (!value) { std::fprintf(stderr, "Flag \"%s\" is missing its value\n", arg); return 1; }
+
+        if (match(arg, "-size")) { opt.size = parse_size(take()); continue; }
+        if (match(arg, "-seed")) { opt.seed = std::strtoull(take(), nullptr, 10); continue; }
+        if (match(arg, "-reps")) { opt.reps = std::max(1, std::atoi(take())); continue; }
+        if (match(arg, "-warmup")) { opt.warmup = std::max(0, std::atoi(take())); continue; }
+        if (match(arg, "-out")) { opt.out = take(); continue; }
+        if (match(arg, "-write")) { opt.write = take(); continue; }
+        if (match(arg, "-j")) {
+            opt.jobs = std::atoi(take());
+            if (opt.jobs <= 0) opt.jobs = std::thread::hardware_concurrency();
+            continue;
+        }
+        if (match(arg, "-shape")) {
+            Shape shape;
+            if (!shape_from_name(take(), shape)) { std::fprintf(stderr, "Unknown shape \"%s\"\n", value); return 1; }
+            opt.shapes.push_back(shape);
+            continue;
+        }
+        std::fprintf(stderr, "Unrecognized flag \"%s\"\n", arg);
+        return 1;
+    }
+
+    if (opt.vm) {
+        std::vector<VmResult> results;
+        if (!run_vm(opt, results)) return 1;
+        std::FILE* f = opt.out ? std::fopen(opt.out, "w") : stdout;
+        if (!f) { std::fprintf(stderr, "can't write %s\n", opt.out); return 1; }
+        report_vm(f, opt, results);
+        if (f != stdout) std::fclose(f);
+        return 0;
+    }
+
+    if (opt.shapes.empty()) for (int i = 0; i < SHAPE_COUNT; i++) opt.shapes.push_back((Shape)i);
+
+    std::vector<Result> results;
+    for (Shape shape : opt.shapes) {
+        Corpus corpus = generate(shape, opt.size, opt.seed);
+        if (opt.write) write_corpus(corpus, opt.write);
+        results.push_back(run(corpus, opt));
+    }
+
+    std::FILE* f = opt.out ? std::fopen(opt.out, "w") : stdout;
+    if (!f) { std::fprintf(stderr, "can't write %s\n", opt.out); return 1; }
+    report(f, opt, results);
+    if (f != stdout) std::fclose(f);
+    for (const Result& result : results) {
+        if (!result.relex_matches) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include "corpus.hpp"
+
+#include <cstring>
+
+// splitmix64, small and the same everywhere (unlike std:: distributions)
+class Rng {
+    std::uint64_t state;
+
+    public:
+        explicit Rng(std::uint64_t seed): state(seed) {}
+
+        std::uint64_t next() {
+            std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+        // [0, n)
+        std::uint32_t below(std::uint32_t n) { return (std::uint32_t)(next() % n); }
+        bool chance(std::uint32_t percent) { return below(100) < percent; }
+        template <typename T, std::size_t N> const T& pick(const T (&list)[N]) { return list[below(N)]; }
+};
+
+static const char* const shape_names[SHAPE_COUNT] = { "mixed", "ident", "number", "comment", "nested", "small_files", "deep" };
+
+const char* shape_name(Shape shape) { return shape_names[(int)shape]; }
+
+bool shape_from_name(const char* name, Shape& shape) {
+    for (int i = 0; i < SHAPE_COUNT; i++) {
+        if (std::strcmp(name, shape_names[i]) == 0) { shape = (Shape)i; return true; }
+    }
+    return false;
+}
+
+static const char* const stems[] = {
+    "index", "value", "count", "total", "left", "right", "node", "next", "prev", "acc",
+    "alpha", "beta", "gamma", "delta", "buffer", "offset", "length", "result", "temp", "item",
+};
+static const char* const ops[] = { " + ", " - ", " * ", " / ", " == ", " != ", " < ", " > ", " <= ", " >= ", " << ", " >> " };
+static const char* const words[] = { "the", "loop", "keeps", "a", "running", "total", "of", "every", "value", "seen", "so", "far" };
+
+// a name out of a vocabulary of stems * 64 suffixes
+static void ident(std::string& out, Rng& rng) {
+    out += rng.pick(stems);
+    if (rng.chance(70)) { out += '_'; out += std::to_string(rng.below(64)); }
+}
+
+static void number(std::string& out, Rng& rng) {
+    switch (rng.below(6)) {
+        case 0: out += std::to_string(rng.below(10)); break;
+        case 1: out += std::to_string(rng.next() % 1000000000000ull); break;
+        case 2: out += std::to_string(rng.below(100000)) + "." + std::to_string(rng.below(1000000)); break;
+        case 3: out += std::to_string(1 + rng.below(999)) + "e" + (rng.chance(50) ? "-" : "") + std::to_string(rng.below(40)); break;
+        case 4: {
+            static const char hex[] = "0123456789abcdef";
+            out += "0x";
+            for (int n = 2 + rng.below(14); n--;) out += hex[rng.below(16)];
+            break;
+        }
+        default: {
+            out += "0b";
+            for (int n = 4 + rng.below(28); n--;) out += (char)('0' + rng.below(2));
+            break;
+        }
+    }
+}
+
+static void comment(std::string& out, Rng& rng, int indent) {
+    out.append(indent * 4, ' ');
+    out += "//";
+    for (int n = 3 + rng.below(12); n--;) { out += ' '; out += rng.pick(words); }
+    out += '\n';
+}
+
+static void expression(std::string& out, Rng& rng, int depth) {
+    if (depth <= 0 || rng.chance(40)) {
+        if (rng.chance(60)) ident(out, rng); else number(out, rng);
+        return;
+    }
+    if (rng.chance(20)) {
+        ident(out, rng);
+        out += '(';
+        for (int n = rng.below(3); n >= 0; n--) { expression(out, rng, depth - 1); if (n) out += ", "; }
+        out += ')';
+        return;
+    }
+    out += '(';
+    expression(out, rng, depth - 1);
+    out += rng.pick(ops);
+    expression(out, rng, depth - 1);
+    out += ')';
+}
+
+// a function in the style of test/fibonacci.dyt
+static void function(std::string& out, Rng& rng) {
+    out += "func (number) "; ident(out, rng); out += " (number "; ident(out, rng); out += ") {\n";
+    if (rng.chance(50)) comment(out, rng, 1);
+    for (int n = 2 + rng.below(6); n--;) {
+        if (rng.chance(25)) {
+            out += "    while ("; expression(out, rng, 2); out += ") {\n";
+            for (int m = 1 + rng.below(3); m--;) {
+                out += "        "; ident(out, rng); out += " = "; expression(out, rng, 3); out += ";\n";
+            }
+            out += "    }\n";
+        } else if (rng.chance(20)) {
+            out += "    if ("; expression(out, rng, 2); out += ") { "; ident(out, rng); out += " = \"";
+            out += rng.pick(words); out += "\"; } else { break; }\n";
+        } else {
+            out += "    "; ident(out, rng); out += " = "; expression(out, rng, 3); out += ";\n";
+        }
+    }
+    out += "    return "; ident(out, rng); out += ";\n}\n\n";
+}
+
+static void ident_statement(std::string& out, Rng& rng) {
+    ident(out, rng); out += " = ";
+    for (int n = 4 + rng.below(12); n--;) { ident(out, rng); if (n) out += rng.pick(ops); }
+    out += ";\n";
+}
+
+static void number_table(std::string& out, Rng& rng) {
+    ident(out, rng); out += " = [\n";
+    for (int row = 8 + rng.below(24); row--;) {
+        out += "    ";
+        for (int n = 8; n--;) { number(out, rng); out += ", "; }
+        out += '\n';
+    }
+    out += "];\n\n";
+}
+
+static void commented(std::string& out, Rng& rng) {
+    for (int n = 3 + rng.below(8); n--;) comment(out, rng, 0);
+    if (rng.chance(50)) out += '\n';
+    ident_statement(out, rng);
+}
+
+static void nested(std::string& out, Rng& rng) {
+    int depth = 16 + rng.below(48);
+    for (int d = 0; d < depth; d++) {
+        out.append(d * 4, ' ');
+        out += "if ("; expression(out, rng, 1); out += ") {\n";
+    }
+    out.append(depth * 4, ' ');
+    ident(out, rng); out += " = "; out.append(depth, '('); ident(out, rng);
+    for (int d = 0; d < depth; d++) { out += rng.pick(ops); number(out, rng); out += ')'; }
+    out += ";\n";
+    for (int d = depth; d--;) { out.append(d * 4, ' '); out += "}\n"; }
+}
+
+// one statement, as a code generator would write it, under the parser's default depth
+static void deep(std::string& out, Rng& rng) {
+    ident(out, rng); out += " = ";
+    std::string closers;
+    for (int d = 500 + rng.below(1500); d--;) {
+        switch (rng.below(4)) {
+            case 0: out += '('; closers += ')'; break;
+            case 1: out += '-'; break;
+            case 2: ident(out, rng); out += '('; closers += ')'; break;
+            default: ident(out, rng); out += rng.pick(ops); break;
+        }
+    }
+    ident(out, rng);
+    out.append(closers.rbegin(), closers.rend());
+    out += ";\n";
+}
+
+Corpus generate(Shape shape, std::size_t size, std::uint64_t seed) {
+    Rng rng(seed * 0x2545f4914f6cdd1dull + (std::uint64_t)shape);
+    Corpus corpus { shape, {} };
+    std::string out;
+    if (shape != Shape::SMALL_FILES) out.reserve(size + 4096);
+
+    std::size_t total = 0;
+    while (total < size) {
+        if (shape == Shape::SMALL_FILES) {
+            std::string file;
+            for (int n = 1 + rng.below(3); n--;) function(file, rng);
+            total += file.size();
+            corpus.files.push_back(std::move(file));
+            continue;
+        }
+
+        switch (shape) {
+            case Shape::MIXED: function(out, rng); break;
+            case Shape::IDENT: ident_statement(out, rng); break;
+            case Shape::NUMBER: number_table(out, rng); break;
+            case Shape::COMMENT: commented(out, rng); break;
+            case Shape::DEEP: deep(out, rng); break;
+            default: nested(out, rng); break;
+        }
+        total = out.size();
+    }
+
+    if (shape != Shape::SMALL_FILES) corpus.files.push_back(std::move(out));
+    return corpus;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// deterministic .dyt corpora for the bench, the same (shape, size, seed)
+// always gives the same bytes on every platform
+
+enum class Shape : char {
+    MIXED,       // functions in the style of test/fibonacci.dyt
+    IDENT,       // long statements over a large vocabulary of names
+    NUMBER,      // lookup tables of int, float, hex and binary constants
+    COMMENT,     // mostly line comments and blank lines
+    NESTED,      // deeply nested blocks and parentheses
+    SMALL_FILES, // the mixed shape cut into many files of a few hundred bytes
+    DEEP,        // generated expressions nested a few thousand levels deep
+};
+
+#define SHAPE_COUNT 7
+
+const char* shape_name(Shape shape);
+// false if there is no shape by that name
+bool shape_from_name(const char* name, Shape& shape);
+
+struct Corpus {
+    Shape shape;
+    std::vector<std::string> files;
+
+    std::size_t bytes() const {
+        std::size_t n = 0;
+        for (const std::string& file : files) n += file.size();
+        return n;
+    }
+};
+
+// at least size bytes in total, split into files only for SMALL_FILES
+Corpus generate(Shape shape, std::size_t size, std::uint64_t seed = 1);
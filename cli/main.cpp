@@ -1,9 +1,25 @@
+#include <algorithm>
 #include <cstring>
 #include <cstdio>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
 
+#include <lang/bytecode.hpp>
+#include <lang/cache.hpp>
 #include <lang/dlex.hpp>
+#include <lang/lines.hpp>
+#include <lang/modules.hpp>
+#include <lang/parser.hpp>
+#include <lang/perf.hpp>
+#include <lang/scan.hpp>
+#include <lang/source.hpp>
+#include <lang/trace.hpp>
+#include <lang/vm.hpp>
 #include <ostream>
 
 template <int Q> bool match(const char* arg, const char (&to)[Q]) {
@@ -17,66 +33,386 @@ template <int Q> bool match(const char* arg, const char (&to)[Q]) {
 #define F_TOKPRINT 1
 #define F_POOLPRINT 2
 #define F_MEASURE 4
+#define F_STREAM 8
+#define F_PERF 16
+#define F_ASTPRINT 32
+#define F_MODULES 64
+#define F_RUN 128
+#define F_BCPRINT 256
 
 // flags: 
 // [-tokprint]: prints out the tokens
+// [-astprint]: prints out the syntax tree
+// [-bcprint]: prints out the bytecode
+// [-run]: runs the program, if it compiled without errors
 // [-poolprint]: prints out pool status
 // [-measure]: measures compilation times
+// [-nosimd]: forces the scalar scanner instead of the detected simd one
+// [-j N]: lexes the files on N threads (0 for every core)
+// [-stream]: lexes each file lazily through a TokenStream ("-" is stdin)
+// [-perf]: reads hardware counters around each phase
+// [-maxdepth=N]: nesting the parser accepts before giving up (default PARSE_MAX_DEPTH)
+// [-trace=FILE]: writes a chrome trace of every phase (open in ui.perfetto.dev)
+// [-cache=DIR]: keeps each file's tokens and tree in DIR, unchanged files skip lexing and parsing
+// [-modules]: compiles what the files get too, each module once, on the -j threads
+// [-I DIR]: looks for modules in DIR after the importer's directory (implies -modules)
+
+// counters of one phase, perf has to be available
+void print_perf(const char* phase, const PerfCounters& perf) {
+    std::cout << "Perf " << phase << ":";
+    for (int i = 0; i < PerfCounters::COUNTER_COUNT; i++) {
+        auto counter = (PerfCounters::Counter)i;
+        std::cout << (i ? ", " : " ") << PerfCounters::name(counter) << " ";
+        if (perf[counter] < 0) std::cout << "n/a";
+        else std::cout << perf[counter];
+    }
+    if (perf[PerfCounters::CYCLES] > 0 && perf[PerfCounters::INSTRUCTIONS] >= 0) {
+        std::cout << " (" << (double)perf[PerfCounters::INSTRUCTIONS] / perf[PerfCounters::CYCLES] << " ipc)";
+    }
+    std::cout << "\n";
+}
+
+void print_pools(const LexOutput& lexout, std::size_t tok_count, const Ast* ast = nullptr) {
+    if (!tok_count) tok_count = 1;
+    std::cout << "Pools:\n";
+    std::vector<PoolUsage> usages = lexout.pool_usage();
+    if (ast) for (const PoolUsage& u : ast->pool_usage()) usages.push_back(u);
+    for (const PoolUsage& u : usages) {
+        std::cout << "  " << u.name << ": " << u.blocks << " blocks, "
+        << u.used << "/" << u.reserved << " bytes used, "
+        << u.wasted << " wasted, "
+        << (u.stats.allocated + u.stats.reused) << " grows (" << u.stats.reused << " reused), "
+        << (double)u.used / tok_count << " bytes/token\n";
+    }
+
+    // the byte pools can leave a tail in every block they moved past
+    auto tails = [](const char* name, const RawPool& pool) {
+        if (pool.block_count() < 2) return;
+        std::cout << "  " << name << " tails:";
+        for (unsigned int i = 0; i + 1 < pool.block_count(); i++) std::cout << " " << pool.tail(i);
+        std::cout << "\n";
+    };
+    tails("arena", lexout.arena());
+    tails("symbols", lexout.symbols().storage());
+}
+
+// every diagnostic in source order (the lexer's come first in the sink). with
+// a source map they're placed by line and column and quoted, the map's line
+// tables are built here, if anything was reported
+int print_diagnostics(const Diagnostics& diags, const std::vector<const char*>& paths, SourceMap* map) {
+    std::vector<const Diagnostic*> sorted;
+    for (const Diagnostic& diag : diags) sorted.push_back(&diag);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Diagnostic* a, const Diagnostic* b) {
+        return a->file != b->file ? a->file < b->file : a->offset < b->offset;
+    });
+    for (const Diagnostic* diag : sorted) {
+        std::cout << paths[diag->file] << ":";
+        if (!map) {
+            Diagnostics::print(std::cout << " byte " << diag->offset << ": error: ", *diag) << "\n";
+            continue;
+        }
+        LineColumn at = map->locate(diag->file, diag->offset);
+        Diagnostics::print(std::cout << at.line << ":" << at.column << ": error: ", *diag) << "\n";
+
+        // the line, and a caret under the column (tabs kept, so it lines up)
+        TextView line = (*map)[diag->file].line(at.line);
+        std::cout << "    " << line << "\n    ";
+        for (std::uint32_t i = 0; i + 1 < at.column && i < line.size(); i++) std::cout << (line.data()[i] == '\t' ? '\t' : ' ');
+        std::cout << "^\n";
+    }
+    return diags.empty() ? 0 : 1;
+}
+
+// tokens are printed as they're pulled, nothing is lexed ahead of the reader
+
+int stream_files(const std::vector<const char*>& paths, int flags, PerfCounters& perf) {
+    if (paths.empty()) {
+        std::cout << "No Source Files given.\n"; return 1;
+    }
+
+    int status = 0;
+    for (const char* path : paths) {
+        bool is_stdin = path[0] == '-' && !path[1];
+        std::FILE* f = is_stdin ? stdin : std::fopen(path, "rb");
+        if (!f) { std::cout << "File " << path << " wasn't found\n"; continue; }
+
+        TRACE_SPAN("stream file", path);
+        TokenStream stream(f);
+        int tok_count = 0;
+        if (flags & F_PERF) perf.start();
+        auto lex_begin = std::chrono::steady_clock::now();
+        for (;;) {
+            const Token& tok = stream.consume();
+            ++ tok_count;
+            if (flags & F_TOKPRINT) tok.print(std::cout, stream.output()) << ", ";
+            if (tok.code() == TokenCode::_EOF) break;
+        }
+        if (flags & F_PERF) perf.stop();
+        if (!is_stdin) std::fclose(f);
+
+        float ms_taken = 1000.f * std::chrono::duration<float>(std::chrono::steady_clock::now() - lex_begin).count();
+        std::cout << "\nStreamed " << tok_count << " tokens from " << path;
+        if (flags & F_MEASURE) std::cout << " in " << ms_taken << " ms";
+        std::cout << "\n";
+        if (flags & F_PERF) print_perf("stream", perf);
+        if (flags & F_POOLPRINT) print_pools(stream.output(), tok_count);
+        // the text is gone once the stream moved past it, only offsets are left
+        status |= print_diagnostics(stream.output().diagnostics(), { path }, nullptr);
+    }
+    return status;
+}
+
+int run(const std::vector<const char*>& paths, int flags, int jobs, std::size_t max_depth, const char* cache_dir, PerfCounters& perf);
+int build_modules(const std::vector<const char*>& paths, int flags, int jobs, std::size_t max_depth, const char* cache_dir, std::vector<std::string> search, PerfCounters& perf);
+int report(const Unit& program, const std::vector<SourceBuffer>& sources, const std::vector<const char*>& loaded, int flags);
 
 int main(int count, const char** args) {
     int flags = 0;
-    const char** srcs = new const char*[64];
-    int char_count = 0;
-    int src_index = 0;
+    int jobs = 1;
+    std::size_t max_depth = PARSE_MAX_DEPTH;
+#if DOYT_TRACE
+    const char* trace_path = nullptr;
+#endif
+    const char* cache_dir = nullptr;
+    std::vector<const char*> paths;
+    std::vector<std::string> search; // -I
 
     --count; ++args;
     while (count--) {
         const char* arg = *(args++);
-        if (*arg == '-') {
+        if (*arg == '-' && arg[1]) { // lone "-" reads stdin
             ++arg;
             if (match(arg, "tokprint")) { flags |= F_TOKPRINT; continue; }
+            if (match(arg, "astprint")) { flags |= F_ASTPRINT; continue; }
+            if (match(arg, "bcprint")) { flags |= F_BCPRINT; continue; }
+            if (match(arg, "run")) { flags |= F_RUN; continue; }
             if (match(arg, "poolprint")) { flags |= F_POOLPRINT; continue; }
             if (match(arg, "measure")) { flags |= F_MEASURE; continue; }
+            if (match(arg, "stream")) { flags |= F_STREAM; continue; }
+            if (match(arg, "perf")) { flags |= F_PERF; continue; }
+            if (match(arg, "modules")) { flags |= F_MODULES; continue; }
+            if (*arg == 'I') {
+                // both -Idir and -I dir
+                if (arg[1]) search.push_back(arg + 1);
+                else if (count) { --count; search.push_back(*(args++)); }
+                flags |= F_MODULES;
+                continue;
+            }
+            if (std::strncmp(arg, "trace=", 6) == 0 && arg[6]) {
+#if DOYT_TRACE
+                trace_path = arg + 6;
+                trace::start();
+#else
+                std::cout << "Tracing was compiled out (DOYT_TRACE=OFF)\n";
+#endif
+                continue;
+            }
+            if (std::strncmp(arg, "cache=", 6) == 0 && arg[6]) {
+                cache_dir = arg + 6;
+                continue;
+            }
+            if (std::strncmp(arg, "maxdepth=", 9) == 0 && arg[9]) {
+                max_depth = std::strtoull(arg + 9, nullptr, 10);
+                continue;
+            }
+            if (match(arg, "nosimd")) { scan::select(scan::Level::SCALAR); continue; }
+            if (*arg == 'j') {
+                // both -j8 and -j 8
+                const char* n = arg[1] ? arg + 1 : (count ? (--count, *(args++)) : "1");
+                jobs = std::atoi(n);
+                if (jobs <= 0) jobs = std::thread::hardware_concurrency();
+                continue;
+            }
             std::cout << "Unrecognized flag \"" << --arg << "\"\n";
         } else {
-            FILE* f = fopen(arg, "r");
-            if (!f) { std::cout << "File " << arg << " wasn't found\n"; continue; }
-            fseek(f, 0, SEEK_END);
-            long size = ftell(f);
-            char_count += size;
-            rewind(f);
-            char* src = new char[size+1];
-            fread(src, 1, size, f);
-            src[size] = '\0';
-            fclose(f);
-            srcs[src_index++] = src;
+            paths.push_back(arg);
+        }
+    }
+
+    PerfCounters perf;
+    if ((flags & F_PERF) && !perf.available()) {
+        std::cout << "Perf counters unavailable: " << perf.why() << "\n";
+        flags &= ~F_PERF;
+    }
+
+    int status = flags & F_MODULES
+        ? build_modules(paths, flags, jobs, max_depth, cache_dir, std::move(search), perf)
+        : run(paths, flags, jobs, max_depth, cache_dir, perf);
+#if DOYT_TRACE
+    if (trace_path && !trace::write(trace_path)) std::cout << "Couldn't write trace to " << trace_path << "\n";
+#endif
+    return status;
+}
+
+// each source from the cache or lexed and parsed on its own (and stored),
+// the units joined in order into program. returns how many were cached
+std::size_t compile_cached(Unit& program, const std::vector<SourceBuffer>& sources, const char* cache_dir, std::size_t max_depth) {
+    TRACE_SPAN("compile cached");
+    UnitCache cache(cache_dir);
+    std::size_t hits = 0;
+    Unit unit;
+    for (const SourceBuffer& source : sources) {
+        // a lone source is the program, as borrowed from the cache
+        Unit& into = sources.size() == 1 ? program : unit;
+        if (cache.load(source, into)) ++ hits;
+        else {
+            compile(into, source, max_depth);
+            cache.store(source, into);
         }
+        if (&into == &program) break;
+        // the unit's first token lands where our _EOF is
+        std::uint32_t token_base = program.lex.count() ? (std::uint32_t)program.lex.count() - 1 : 0;
+        program.lex.append(unit.lex);
+        program.ast.append(unit.ast, token_base);
+    }
+    return hits;
+}
+
+int run(const std::vector<const char*>& paths, int flags, int jobs, std::size_t max_depth, const char* cache_dir, PerfCounters& perf) {
+    if (flags & F_STREAM) return stream_files(paths, flags, perf);
+
+    if (flags & F_PERF) perf.start();
+    std::vector<SourceBuffer> sources;
+    std::vector<const char*> loaded; // path of each source
+    std::size_t char_count = 0;
+    for (const char* path : paths) {
+        TRACE_SPAN("load", path);
+        SourceBuffer source = SourceBuffer::load(path);
+        if (!source) { std::cout << "File " << path << " wasn't found\n"; continue; }
+        char_count += source.size();
+        sources.push_back(std::move(source));
+        loaded.push_back(path);
     }
 
-    if (!src_index) {
+    if (flags & F_PERF) perf.stop();
+
+    if (sources.empty()) {
         std::cout << "No Source Files given.\n"; return 1;
     }
-    std::cout << "Parsing " << src_index << " file(s) with " << char_count << " characters";
+    if (flags & F_PERF) print_perf("load", perf);
+    std::cout << "Parsing " << sources.size() << " file(s) with " << char_count << " characters\n";
+
+    Unit program;
+    LexOutput& lexout = program.lex;
+    Ast& ast = program.ast;
+    if (cache_dir) {
+        if (flags & F_PERF) perf.start();
+        auto begin = std::chrono::steady_clock::now();
+        std::size_t hits = compile_cached(program, sources, cache_dir, max_depth);
+        if (flags & F_PERF) perf.stop();
+
+        float ms_taken = 1000.f * std::chrono::duration<float>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << hits << "/" << sources.size() << " file(s) from " << cache_dir << "\n";
+        if (flags & F_MEASURE) {
+            std::cout << "Took " << ms_taken << " ms for " << lexout.count() << " tokens and "
+            << ast.size() << " nodes (" << (char_count / ms_taken) << " char/ms)\n";
+        }
+        if (flags & F_PERF) print_perf("cache", perf);
+        return report(program, sources, loaded, flags);
+    }
 
+    if (flags & F_PERF) perf.start();
     auto parse_begin = std::chrono::steady_clock::now();
-    LexOutput lexout = tokenize(srcs, src_index, flags);
+    {
+        TRACE_SPAN("tokenize");
+        tokenize(lexout, sources.data(), sources.size(), flags, jobs);
+    }
+    if (flags & F_PERF) perf.stop();
 
     float ms_taken = 1000.f * std::chrono::duration<float>(std::chrono::steady_clock::now() - parse_begin).count();
     if (flags & F_MEASURE) {
         std::cout << 
         "Took " << ms_taken << " ms ("
-        << (ms_taken / src_index) << " ms/file, "
+        << (ms_taken / sources.size()) << " ms/file, "
         << (char_count / ms_taken) << " char/ms)\n";
     }
+    if (flags & F_PERF) print_perf("lex", perf);
+
+    if (flags & F_PERF) perf.start();
+    auto ast_begin = std::chrono::steady_clock::now();
+    {
+        TRACE_SPAN("parse");
+        parse(ast, lexout, lexout.diagnostics(), max_depth);
+    }
+    if (flags & F_PERF) perf.stop();
+
+    ms_taken = 1000.f * std::chrono::duration<float>(std::chrono::steady_clock::now() - ast_begin).count();
+    if (flags & F_MEASURE) {
+        std::cout << "Built " << ast.size() << " nodes in " << ms_taken << " ms ("
+        << (lexout.count() / ms_taken) << " tokens/ms)\n";
+    }
+    if (flags & F_PERF) print_perf("parse", perf);
+    return report(program, sources, loaded, flags);
+}
+
+int build_modules(const std::vector<const char*>& paths, int flags, int jobs, std::size_t max_depth, const char* cache_dir, std::vector<std::string> search, PerfCounters& perf) {
+    std::unique_ptr<UnitCache> cache;
+    if (cache_dir) cache = std::make_unique<UnitCache>(cache_dir);
+    ModuleGraph graph(std::move(search), cache.get(), max_depth);
+    for (const char* path : paths) {
+        if (!graph.add_root(path)) std::cout << "File " << path << " wasn't found\n";
+    }
+    if (!graph.size()) {
+        std::cout << "No Source Files given.\n"; return 1;
+    }
+
+    if (flags & F_PERF) perf.start();
+    auto begin = std::chrono::steady_clock::now();
+    graph.build(jobs);
+    Unit program;
+    std::vector<SourceBuffer> sources;
+    std::vector<std::string> linked;
+    graph.link(program, sources, linked);
+    if (flags & F_PERF) perf.stop();
+
+    float ms_taken = 1000.f * std::chrono::duration<float>(std::chrono::steady_clock::now() - begin).count();
+    std::size_t char_count = 0;
+    for (const SourceBuffer& source : sources) char_count += source.size();
+    std::cout << "Compiled " << graph.size() << " module(s) with " << char_count << " characters";
+    if (cache) std::cout << ", " << graph.cached() << " from " << cache_dir;
+    std::cout << "\n";
+    if (flags & F_MEASURE) {
+        std::cout << "Took " << ms_taken << " ms on " << (jobs > 1 ? jobs : 1) << " thread(s) for " << program.lex.count()
+        << " tokens and " << program.ast.size() << " nodes (" << (char_count / ms_taken) << " char/ms)\n";
+    }
+    if (flags & F_PERF) print_perf("modules", perf);
+
+    std::vector<const char*> loaded;
+    for (const std::string& path : linked) loaded.push_back(path.c_str());
+    return report(program, sources, loaded, flags);
+}
+
+// diagnostics and whatever was asked to be printed of a compiled program
+int report(const Unit& program, const std::vector<SourceBuffer>& sources, const std::vector<const char*>& loaded, int flags) {
+    const LexOutput& lexout = program.lex;
+    const Ast& ast = program.ast;
+    SourceMap map(sources);
+    int status = print_diagnostics(lexout.diagnostics(), loaded, &map);
+    if (flags & F_POOLPRINT) print_pools(lexout, lexout.count(), &ast);
 
     if (flags & F_TOKPRINT) {
         std::cout << "Parsed " << lexout.count() << " tokens\n";
-        auto tok_iter = lexout.token_pool.iterator();
-        while (tok_iter.has_next()) {
-            tok_iter.consume().print(std::cout) << ", ";
-        }
+        for (const Token& tok : lexout.tokens()) tok.print(std::cout, lexout) << ", ";
     }
-    
-    return 0;
+    if (flags & F_ASTPRINT) {
+        if (flags & F_TOKPRINT) std::cout << "\n";
+        std::cout << "Built " << ast.size() << " nodes\n";
+        ast.print(std::cout, lexout);
+    }
+    if (status || !(flags & (F_RUN | F_BCPRINT))) return status;
 
+    // what the program does wrong itself, compiling or running
+    Diagnostics problems;
+    Bytecode bytecode;
+    if (compile_bytecode(bytecode, ast, lexout, problems)) {
+        if (flags & F_BCPRINT) bytecode.print(std::cout);
+        if (flags & F_RUN) {
+            auto begin = std::chrono::steady_clock::now();
+            VM vm(bytecode, lexout, problems, std::cout);
+            vm.run();
+            float ms_taken = 1000.f * std::chrono::duration<float>(std::chrono::steady_clock::now() - begin).count();
+            if (flags & F_MEASURE) std::cout << "Ran in " << ms_taken << " ms\n";
+        }
+    }
+    return print_diagnostics(problems, loaded, &map);
 }
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <lang/diagnostics.hpp>
+#include <lang/dlex.hpp>
+#include <lang/parser.hpp>
+
+// every opcode as (Opcode, name), in enum order. A, B and C are registers
+// of the running function (or small immediates where said), Bx an unsigned
+// and sBx a signed 16 bit operand in place of B and C. a jump lands at the
+// instruction after it plus sBx
+#define DOYT_OPCODES(X) \
+    X(MOVE, "move")           /* A = B */ \
+    X(LOADK, "loadk")         /* A = constants[Bx] */ \
+    X(LOADI, "loadi")         /* A = sBx, an int */ \
+    X(LOADNIL, "loadnil")     /* A = nil */ \
+    X(LOADBOOL, "loadbool")   /* A = B, a bool */ \
+    X(GETGLOBAL, "getglobal") /* A = globals[Bx] */ \
+    X(SETGLOBAL, "setglobal") /* globals[Bx] = A */ \
+    X(ADD, "add")   X(SUB, "sub")   X(MUL, "mul")   X(DIV, "div") /* A = B op C */ \
+    X(SHL, "shl")   X(SHR, "shr")   \
+    X(EQ, "eq")     X(NEQ, "neq")   X(LT, "lt")     X(LTEQ, "lteq") \
+    X(ADDI, "addi")           /* A = B + C, C a signed byte. LOADI and ADD in one */ \
+    X(NEG, "neg")   X(NOT, "not") /* A = op B */ \
+    X(JMP, "jmp")             /* jumps by sBx */ \
+    X(JMPF, "jmpf")           /* jumps by sBx if A is falsy */ \
+    X(JMPT, "jmpt")           /* jumps by sBx if A is truthy */ \
+    X(JEQ, "jeq")   X(JNEQ, "jneq") X(JLT, "jlt")   X(JLTEQ, "jlteq") /* compare and branch: the next word */ \
+                              /* is a JMP, taken if (A op B) == C, skipped otherwise. a compare and the jump */ \
+                              /* after it in one dispatch */ \
+    X(FORPREP, "forprep")     /* A, A+1, A+2 are counter, limit and step. jumps by sBx if the loop doesn't run */ \
+    X(FORLOOP, "forloop")     /* counter += step, jumps by sBx (back) while it's within the limit */ \
+    X(CALL, "call")           /* A = A(A+1 ... A+B) */ \
+    X(RET, "ret")             /* returns A */ \
+    X(RET0, "ret0")           /* returns nil */
+
+enum class Opcode : std::uint8_t {
+#define OPCODE(op, name) op,
+    DOYT_OPCODES(OPCODE)
+#undef OPCODE
+    _COUNT,
+};
+
+const char* opcode_name(Opcode op) noexcept;
+
+// 4 bytes: op, then A, B, C or A, Bx
+class Instr {
+    std::uint32_t word;
+
+    constexpr explicit Instr(std::uint32_t word): word(word) {}
+
+    public:
+        constexpr Instr(): word(0) {}
+        static constexpr Instr abc(Opcode op, std::uint8_t a, std::uint8_t b = 0, std::uint8_t c = 0) {
+            return Instr((std::uint32_t)op | (std::uint32_t)a << 8 | (std::uint32_t)b << 16 | (std::uint32_t)c << 24);
+        }
+        static constexpr Instr abx(Opcode op, std::uint8_t a, std::uint16_t bx) {
+            return Instr((std::uint32_t)op | (std::uint32_t)a << 8 | (std::uint32_t)bx << 16);
+        }
+        static constexpr Instr asbx(Opcode op, std::uint8_t a, std::int16_t sbx) { return abx(op, a, (std::uint16_t)sbx); }
+
+        constexpr Opcode op() const noexcept { return (Opcode)(word & 0xff); }
+        constexpr std::uint8_t a() const noexcept { return (std::uint8_t)(word >> 8); }
+        constexpr std::uint8_t b() const noexcept { return (std::uint8_t)(word >> 16); }
+        constexpr std::uint8_t c() const noexcept { return (std::uint8_t)(word >> 24); }
+        constexpr std::uint16_t bx() const noexcept { return (std::uint16_t)(word >> 16); }
+        constexpr std::int16_t sbx() const noexcept { return (std::int16_t)(word >> 16); }
+
+        // for patching jumps once their target is known
+        void set_sbx(std::int16_t sbx) noexcept { word = (word & 0xffff) | (std::uint32_t)(std::uint16_t)sbx << 16; }
+};
+static_assert(sizeof(Instr) == 4);
+
+// registers a function can have, A, B and C are a byte
+#define VM_MAX_REGISTERS 250
+
+enum class ValueType : std::uint8_t { NIL, BOOL, INT, FLOAT, STRING, FUNCTION, NATIVE };
+
+// 16 bytes. strings, functions and natives are indices into the Bytecode
+// and the VM's native table
+struct Value {
+    ValueType type = ValueType::NIL;
+    union {
+        bool b;
+        std::int64_t i = 0;
+        double f;
+        std::uint32_t index;
+    };
+
+    static Value boolean(bool b) { Value v; v.type = ValueType::BOOL; v.b = b; return v; }
+    static Value integer(std::int64_t i) { Value v; v.type = ValueType::INT; v.i = i; return v; }
+    static Value number(double f) { Value v; v.type = ValueType::FLOAT; v.f = f; return v; }
+    static Value of(ValueType type, std::uint32_t index) { Value v; v.type = type; v.index = index; return v; }
+};
+static_assert(sizeof(Value) == 16);
+
+// one func, or the top level of the program (function 0)
+struct Function {
+    std::string name;
+    std::vector<Instr> code;
+    std::vector<Value> constants;
+    std::vector<std::uint32_t> tokens; // per instruction, what it came from, for runtime errors
+    std::uint8_t params = 0;
+    std::uint8_t registers = 0;
+};
+
+// a whole program, compiled. globals are slots known by name at compile
+// time, the VM fills the ones named like a native before running
+struct Bytecode {
+    std::vector<Function> functions;
+    std::vector<std::string> strings;
+    std::vector<std::string> globals;
+
+    std::ostream& print(std::ostream& stream) const;
+};
+
+// compiles a tree without syntax errors into into, which is cleared first.
+// what the compiler can't do yet (arrays, members) is reported, false then
+bool compile_bytecode(Bytecode& into, const Ast& ast, const LexOutput& lex, Diagnostics& diags);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <lang/dlex.hpp>
+#include <lang/parser.hpp>
+#include <lang/source.hpp>
+
+// bumped whenever the layout of a cached unit (or of Token, Node or
+// Diagnostic, which are stored as they are) changes
+#define DOYT_CACHE_FORMAT 1
+
+// 64 bits of a fast non-cryptographic hash, 32 bytes per step
+std::uint64_t hash_bytes(const void* data, std::size_t size, std::uint64_t seed = 0) noexcept;
+
+// one source, lexed and parsed on its own. what the cache keeps per file,
+// LexOutput::append and Ast::append join units into one compilation
+struct Unit {
+    LexOutput lex;
+    Ast ast;
+};
+
+// lexes and parses source into unit, which is reset first
+void compile(Unit& unit, const SourceBuffer& source, std::size_t max_depth = PARSE_MAX_DEPTH);
+
+// units on disk, one file each, named after a hash of the source's bytes and
+// the compiler version, so an edit or an upgrade just misses. the file is the
+// unit's pools as they are in memory, only indices in it, no pointers: a hit
+// maps it (copy on write) and the pools borrow their items from the mapping.
+// symbol names are interned again and string views pointed into the source,
+// both a small part of a unit. a file that is short, from another format or
+// fails its checksum is a miss, and gets overwritten on the next store
+class UnitCache {
+    std::string dir;
+
+    std::string path_of(std::uint64_t key) const;
+
+    public:
+        // creates dir if it's missing
+        explicit UnitCache(const char* dir);
+
+        // the key of a source, its hash mixed with the version
+        static std::uint64_t key_of(const SourceBuffer& source) noexcept;
+
+        // false on a miss or a file that doesn't check out, unit is reset then.
+        // on a hit unit borrows from the mapping and source has to outlive it
+        bool load(const SourceBuffer& source, Unit& unit) const;
+        // written to a temporary and renamed over, readers never see half a
+        // file. false if it couldn't be written
+        bool store(const SourceBuffer& source, const Unit& unit) const;
+};
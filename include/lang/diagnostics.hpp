@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <lang/pool.hpp>
+
+// every diagnostic as (DiagCode, format), in enum order, the lexer's first.
+// formats are only expanded when printed, each directive takes the next argument:
+// %t a TokenCode, %c a character, %k a NodeKind, %n a number
+#define DOYT_DIAGNOSTICS(X) \
+    X(UNKNOWN_CHAR, "unknown character '%c', skipped") \
+    X(UNKNOWN_CHARS, "unknown characters starting with '%c', %n skipped") \
+    X(UNTERMINATED_STRING, "string runs to the end of the file") \
+    X(WIDE_NUMBER, "number doesn't fit in 64 bits") \
+    X(BAD_SEPARATOR, "'_' in a number has to sit between two digits") \
+    X(EXPECTED_EXPRESSION, "expected an expression, found %t") \
+    X(BAD_ASSIGN, "can only assign to a name, index or member") \
+    X(EXPECTED_MEMBER, "expected a name after '.', found %t") \
+    X(UNCLOSED_GROUP, "expected ')' to close '(', found %t") \
+    X(UNCLOSED_CALL, "expected ')' to close the call, found %t") \
+    X(UNCLOSED_INDEX, "expected ']' to close the index, found %t") \
+    X(UNCLOSED_ARRAY, "expected ']' to close the array, found %t") \
+    X(EXPECTED_BLOCK, "expected '{', found %t") \
+    X(UNCLOSED_BLOCK, "expected '}' to close the block, found %t") \
+    X(UNMATCHED_CLOSE, "'}' without a block to close") \
+    X(EXPECTED_RETURN_TYPE, "expected the return type, found %t") \
+    X(UNCLOSED_RETURN_TYPE, "expected ')' after the return type, found %t") \
+    X(EXPECTED_FUNC_NAME, "expected the function's name, found %t") \
+    X(EXPECTED_PARAMS, "expected '(' before the parameters, found %t") \
+    X(EXPECTED_PARAM, "expected a parameter, found %t") \
+    X(UNCLOSED_PARAMS, "expected ')' after the parameters, found %t") \
+    X(EXPECTED_HEADER, "expected '(' after %t, found %t") \
+    X(UNCLOSED_HEADER, "expected ')' after the %t header, found %t") \
+    X(EXPECTED_SEMI, "expected ';' after %t, found %t") \
+    X(EXPECTED_SEMI_EXPRESSION, "expected ';' after the expression, found %t") \
+    X(TOO_DEEP_EXPRESSION, "expression nested deeper than %n levels, skipped") \
+    X(TOO_DEEP_STATEMENT, "statements nested deeper than %n levels, skipped") \
+    X(BAD_MODULE, "expected a module name or a path string after 'get'") \
+    X(MODULE_NOT_FOUND, "no module found for this 'get'") \
+    X(UNREADABLE_MODULE, "the module of this 'get' couldn't be read") \
+    X(IMPORT_CYCLE, "this 'get' closes a cycle of %n modules") \
+    X(UNSUPPORTED, "the compiler can't run %k yet") \
+    X(BAD_FOR, "expected 'for (name = start, limit)', an optional step or just a condition") \
+    X(OUTSIDE_LOOP, "%t outside of a loop") \
+    X(TOO_MANY_REGISTERS, "function needs more than %n registers") \
+    X(TOO_MANY_CONSTANTS, "function has more than %n constants") \
+    X(TOO_FAR_JUMP, "jump over more than %n instructions") \
+    X(TOO_MANY_ARGUMENTS, "call with more than %n arguments") \
+    X(BAD_OPERANDS, "arithmetic on a value that isn't a number") \
+    X(BAD_COMPARE, "ordering values that aren't both numbers") \
+    X(DIVIDE_BY_ZERO, "integer division by zero") \
+    X(NOT_CALLABLE, "called a value that isn't a function") \
+    X(ARGUMENT_COUNT, "function takes %n arguments, called with %n") \
+    X(STACK_OVERFLOW, "calls nested deeper than %n levels") \
+    X(BAD_FOR_VALUES, "for needs numbers, and a step that isn't 0")
+
+enum class DiagCode : std::uint8_t {
+#define DIAG(code, format) code,
+    DOYT_DIAGNOSTICS(DIAG)
+#undef DIAG
+};
+
+// the lexer's codes are the ones up to this
+constexpr DiagCode LAST_LEXER_DIAG = DiagCode::BAD_SEPARATOR;
+
+// 20 bytes, no text. where it happened is a byte offset into one of the
+// sources, in the order they were given to tokenize()
+struct Diagnostic {
+    DiagCode code;
+    std::uint32_t file, offset;
+    std::uint32_t args[2];
+};
+
+// every problem found while compiling, in the order found. reporting never
+// throws or formats anything, messages are built only when printed
+class Diagnostics {
+    Pool<Diagnostic> pool;
+
+    public:
+        void report(DiagCode code, std::uint32_t file, std::uint32_t offset, std::uint32_t arg0 = 0, std::uint32_t arg1 = 0) {
+            pool.insert({ code, file, offset, { arg0, arg1 } });
+        }
+        // the last report, to fold repeats into. null if there is none
+        Diagnostic* last() { return pool.size() ? &pool[pool.size() - 1] : nullptr; }
+
+        // drops what was reported since the sink had size reports
+        void truncate(std::size_t size) {
+            while (pool.size() > size) pool.pop_back();
+        }
+
+        std::size_t size() const { return pool.size(); }
+        bool empty() const { return !pool.size(); }
+        const Diagnostic& operator[](std::size_t i) const { return pool[i]; }
+        auto begin() const { return pool.begin(); }
+        auto end() const { return pool.end(); }
+
+        // for text replaced in file: drops the reports in [begin, end) of the
+        // old text and moves the ones past it by delta. only the first count
+        // reports are looked at. the later ones (the lexer's, about the new
+        // text) go where a lexer reading the whole new text would have put
+        // them, after the lexer's reports before the edit
+        void rebase(std::uint32_t file, std::uint32_t begin, std::uint32_t end, std::int64_t delta, std::size_t count) {
+            std::size_t kept = 0, old_kept = 0, at = SIZE_MAX;
+            for (std::size_t i = 0; i < pool.size(); i++) {
+                Diagnostic diag = pool[i];
+                if (i < count && at == SIZE_MAX && (diag.code > LAST_LEXER_DIAG || diag.file > file
+                    || (diag.file == file && diag.offset >= end))) at = kept;
+                if (i < count && diag.file == file && diag.offset >= begin) {
+                    if (diag.offset < end) continue;
+                    diag.offset = (std::uint32_t)(diag.offset + delta);
+                }
+                pool[kept++] = diag;
+                if (i < count) old_kept = kept;
+            }
+            truncate(kept);
+
+            if (at >= old_kept) return;
+            std::vector<Diagnostic> fresh;
+            for (std::size_t i = old_kept; i < kept; i++) fresh.push_back(pool[i]);
+            for (std::size_t i = old_kept; i-- > at;) pool[i + fresh.size()] = pool[i];
+            for (std::size_t i = 0; i < fresh.size(); i++) pool[at + i] = fresh[i];
+        }
+
+        // appends another sink's reports, moved by file_base files
+        void absorb(const Diagnostics& other, std::uint32_t file_base = 0) {
+            for (Diagnostic diag : other.pool) {
+                diag.file += file_base;
+                pool.insert(diag);
+            }
+        }
+
+        PoolUsage usage(const char* name) const { return pool.usage(name); }
+        void reset() { pool.reset(); }
+
+        // the message, formatted now
+        static std::ostream& print(std::ostream& stream, const Diagnostic& diag);
+};
@@ -1,27 +1,46 @@
 #pragma once
 
 #include <ostream>
+#include <cstdio>
+#include <cstdint>
 #include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <vector>
+#include <lang/diagnostics.hpp>
 #include <lang/pool.hpp>
+#include <lang/scan.hpp>
+#include <lang/source.hpp>
+#include <lang/symbols.hpp>
 #include <lang/view.hpp>
 
+// every keyword as (TokenCode, spelling), in enum order
+// drives the enum, the lexer's keyword hash and Token::print
+#define DOYT_KEYWORDS(X) \
+    X(RET, "return")     \
+    X(FUNC, "func")      /* function declaration */ \
+    X(GET, "get")        /* analogue for #include or require() */ \
+    X(IF, "if")          \
+    X(ELSE, "else")      \
+    X(WHILE, "while")    \
+    X(FOR, "for")        /* for (i = first, last) */ \
+    X(BREAK, "break")    \
+    X(CONTINUE, "continue")
+
 enum class TokenCode : char {
     // Control Tokens:
     _EOF = 0,   // End of File
 
     // Keyword Tokens:
-    RET,       // return
-    FUNC,      // function declaration
-    GET,      // get (analogue for #include or require())
-    IF,
-    ELSE,
-    WHILE,
-    BREAK,
-    CONTINUE,
+#define KEYWORD(code, text) code,
+    DOYT_KEYWORDS(KEYWORD)
+#undef KEYWORD
         
     // Literals
-    IDENTITY,    // Identity
-    NUMBER,      // Number, temporary but really just a float
+    IDENTITY,    // Identity, carries its symbol id
+    INT,         // Integer, 64 bit, decimal, 0x hex or 0b binary
+    FLOAT,       // Floating point, double
     STRING,      // String
     CHAR,        // Character
     BOOL,        // Boolean (true/false)
@@ -41,55 +60,309 @@ enum class TokenCode : char {
     GT2, LT2,   // >> <<
     GT, LT,     // > <
     NEQ,         // !=
+
+    _COUNT,      // not a token, the number of codes, for tables indexed by code
 };
 
 class LexOutput;
 
-// pointer to char pointer so that many sources can be compiled as one
-LexOutput tokenize(const char** src, int src_count, int flags = 0);
+// how a code reads in a message: "')'", "return", "a name", "the end of the file"
+const char* token_text(TokenCode code);
+
+// sources of at least twice this are split into chunks when lexing with jobs
+#define LEX_CHUNK_SIZE (1 << 20)
+
+// many sources are compiled as one. they are SourceBuffers, the scanner
+// reads whole aligned blocks and relies on their padding. jobs > 1 lexes
+// the sources (and chunks of big ones) on that many threads, output is
+// identical to the serial run
+LexOutput tokenize(const SourceBuffer* src, std::size_t src_count, int flags = 0, int jobs = 1);
+// same, into an output that is reset first. it keeps its memory, so a caller
+// compiling unit after unit stops allocating once it has seen its largest one
+void tokenize(LexOutput& into, const SourceBuffer* src, std::size_t src_count, int flags = 0, int jobs = 1);
+
+// bytes [begin, old_end) of a source were replaced, they are [begin, new_end) of its new text
+struct TextEdit { std::uint32_t begin, old_end, new_end; };
+// tokens [begin, old_end) were replaced by [begin, new_end), the ones past
+// them only moved. a parser can keep what it built from the rest
+struct TokenEdit { std::size_t begin, old_end, new_end; };
+
+// updates one file of into after an edit of its text. source is the whole
+// new text and takes the old one's place, strings are read from it.
+// only the tokens around the edit are lexed again: from a token before it,
+// until a token starts where an old one did. the rest stay where they are,
+// the tokens after an edit count their offsets from the end of the file,
+// so only the ones between it and the previous edit are touched. the
+// file's reports in that stretch are dropped for the new ones, the
+// parser's go stale like the tree does. the string, int and float payloads
+// of the replaced tokens are reused by later ones, so the side tables hold
+// as many as the text had at most over a session of edits
+TokenEdit relex(LexOutput& into, std::size_t file, const SourceBuffer& source, TextEdit edit);
 
+// 8 bytes, no heap. the payload is either stored inline (symbol ids, chars,
+// bools) or is an index into a side table of the LexOutput (strings, numbers)
 class Token {
     TokenCode tcode;
-    void* data = nullptr;
+    std::uint32_t data = 0;
 
     public:
-        TokenCode code() const noexcept { return tcode; }
-        Token(): tcode(TokenCode::_EOF) {}
-        Token(TokenCode code): tcode(code) {}
+        constexpr TokenCode code() const noexcept { return tcode; }
+        constexpr Token(): tcode(TokenCode::_EOF) {}
+        constexpr Token(TokenCode code): tcode(code) {}
         template <typename T> Token(TokenCode code, T val): tcode(code) {
-            if (sizeof(T) > 8) data = new char[sizeof(T)];
-            
-            std::memcpy(data, &val, sizeof(T));
+            static_assert(sizeof(T) <= sizeof(data), "payload too big for a token, use a side table");
+            std::memcpy(&data, &val, sizeof(T));
         }
         
         template <typename T> T value() const {
+            static_assert(sizeof(T) <= sizeof(data), "payload too big for a token, use a side table");
             T val;
-            std::memcpy(&val, (sizeof(T) > 8) ? data : &data, sizeof(T));
+            std::memcpy(&val, &data, sizeof(T));
 
             return val;
         }
 
-        std::ostream& print(std::ostream& stream) const;
+        // lex resolves symbol ids and side table payloads
+        std::ostream& print(std::ostream& stream, const LexOutput& lex) const;
+};
+static_assert(sizeof(Token) == 8);
+
+// resumable lexer over one source, hands out one token per next() call
+// identifiers are interned into out's symbol table
+class Lexer {
+    LexOutput& out;
+    const char* src;
+    const char* stop;
+    const char* origin;         // where lexing began
+    std::uint32_t origin_offset; // its byte offset into the file
+    std::uint32_t file;          // index of the file, for diagnostics
+    const char* token_start = nullptr;
+    std::size_t first_report; // runs of unknown chars only fold into reports made from here on
+    const char* block = nullptr; // the aligned 64 bytes masks is of
+    scan::Masks masks;
+
+    // p's bit in masks, classifying its block if it's a new one
+    std::uint64_t bit_of(const char* p);
+    // first byte from p on that isn't in the class
+    const char* skip(const char* p, std::uint64_t scan::Masks::* cls);
+
+    public:
+        static inline const char* const NO_STOP = (const char*)~std::uintptr_t(0);
+
+        // only tokens starting before stop are lexed. offset is where src is
+        // in its file, when lexing starts partway into one
+        Lexer(LexOutput& out, const char* src, const char* stop = NO_STOP, std::uint32_t offset = 0, std::uint32_t file = 0);
+
+        // false once stop or the end of the source is reached
+        bool next(Token& tok);
+        const char* position() const noexcept { return src; }
+        // byte offset of p into the file
+        std::uint32_t offset_of(const char* p) const noexcept { return origin_offset + (std::uint32_t)(p - origin); }
+        // byte offset of the token next() returned
+        std::uint32_t offset() const noexcept { return offset_of(token_start); }
 };
 
+// [begin, end) token indices
+struct TokenRange { std::size_t begin, end; };
+
 class LexOutput {
-    friend LexOutput tokenize(const char**, int, int);
+    friend LexOutput tokenize(const SourceBuffer*, std::size_t, int, int);
+    friend void tokenize(LexOutput&, const SourceBuffer*, std::size_t, int, int);
+    friend TokenEdit relex(LexOutput&, std::size_t, const SourceBuffer&, TextEdit);
     friend int main(int, const char**);
-    RawPool pool;
+    friend class Lexer;
+    friend class TokenStream;
+    friend class UnitCache;
+
+    // offsets at or past this count back from the end of their file, they
+    // hold offset - size - 1. relex() leaves them as they are when text
+    // before them changes size. files are under 2 GiB
+    static constexpr std::uint32_t FROM_END = 1u << 31;
+    // a STRING payload, the text between the quotes. offset is kept like the
+    // token's, so it needs no update when the token's doesn't
+    struct StringPiece { std::uint32_t file, offset, length; };
+    struct FileText {
+        const char* data;
+        std::uint32_t size;
+        std::size_t from_end = SIZE_MAX; // first token, counted from the file's first, whose offset counts from the end
+    };
+
+    RawPool pool; // arena for the containers below
     Pool<Token> token_pool;
-    int tok_count = 0;
-    void emit(TokenCode code) {
-        ++ tok_count;
-        token_pool.emplace(code);
+    Pool<std::uint32_t> offset_pool; // byte offset of every token into its file, kept apart so a Token stays 8 bytes
+    SymbolTable symbol_table; // shared by every source in one tokenize() call
+    Pool<StringPiece> string_table; // STRING payloads
+    Pool<std::int64_t> int_table; // INT payloads
+    Pool<double> float_table;     // FLOAT payloads
+    // payload slots no token points at anymore, relex() fills them first
+    Pool<std::uint32_t> free_strings, free_ints, free_floats;
+    std::pmr::vector<TokenRange> file_ranges{ &pool };
+    std::pmr::vector<FileText> file_texts{ &pool }; // what strings are read from
+    Diagnostics diagnostic_sink; // the compilation's, the parser reports here as well
+    std::shared_ptr<const void> backing; // what borrowed pools point into, see UnitCache
+    std::size_t read = 0; // peek/consume position
+    
+    // lexes tokens starting before stop, returns where it stopped. offset
+    // and file are src's place, as the Lexer takes them
+    const char* lex_source(const char* src, const char* stop = Lexer::NO_STOP, std::uint32_t offset = 0, std::uint32_t file = 0);
+    // lexes a whole source and records its token range, returns its length
+    std::uint32_t lex_file(const char* src);
+    // pool memory as a counter track, when tracing
+    void trace_pools() const;
+    // appends another output's tokens, remapping its symbol ids into ours.
+    // its offsets are taken as they are, its reports moved by file_base files
+    void absorb(const LexOutput& shard, std::uint32_t file_base = 0);
+    static void lex_sources(LexOutput& into, const SourceBuffer* src, std::size_t src_count, int jobs);
+
+    // a stored offset of file as a byte offset into it
+    std::uint32_t real_offset(std::uint32_t file, std::uint32_t offset) const {
+        return offset < FROM_END ? offset : offset + file_texts[file].size + 1;
     }
 
-    template <typename T> void emit(TokenCode code, T value) {
-        ++ tok_count;
-        token_pool.emplace(code, value);
+    std::uint32_t add_string(std::uint32_t file, std::uint32_t offset, std::uint32_t length) {
+        string_table.insert({ file, offset, length });
+        return (std::uint32_t)string_table.size() - 1;
+    }
+    std::uint32_t add_int(std::int64_t value) {
+        int_table.insert(value);
+        return (std::uint32_t)int_table.size() - 1;
+    }
+    std::uint32_t add_float(double value) {
+        float_table.insert(value);
+        return (std::uint32_t)float_table.size() - 1;
+    }
+
+    void emit(TokenCode code, std::uint32_t offset) {
+        token_pool.emplace(code);
+        offset_pool.insert(offset);
     }
 
     public:
-        int count() const { return tok_count; }
-        const Token& peek() const;
-        const Token& consume();
-};
\ No newline at end of file
+        LexOutput() = default;
+        // file_ranges and file_texts have to follow the pool they draw from
+        LexOutput(LexOutput&& other) noexcept
+            : pool(std::move(other.pool)), token_pool(std::move(other.token_pool)), offset_pool(std::move(other.offset_pool)),
+              symbol_table(std::move(other.symbol_table)), string_table(std::move(other.string_table)),
+              int_table(std::move(other.int_table)), float_table(std::move(other.float_table)),
+              free_strings(std::move(other.free_strings)), free_ints(std::move(other.free_ints)), free_floats(std::move(other.free_floats)),
+              file_ranges(other.file_ranges.begin(), other.file_ranges.end(), &pool),
+              file_texts(other.file_texts.begin(), other.file_texts.end(), &pool),
+              diagnostic_sink(std::move(other.diagnostic_sink)), backing(std::move(other.backing)), read(other.read) {}
+
+        std::size_t count() const { return token_pool.size(); }
+        const Pool<Token>& tokens() const { return token_pool; }
+        // byte offset of a token into its file, the final _EOF is at the end of the last one
+        std::uint32_t offset(std::size_t token) const {
+            std::uint32_t offset = offset_pool[token];
+            return offset < FROM_END ? offset : real_offset(file_of(token), offset);
+        }
+        const SymbolTable& symbols() const { return symbol_table; }
+        TextView string(std::uint32_t index) const {
+            StringPiece piece = string_table[index];
+            std::uint32_t at = real_offset(piece.file, piece.offset);
+            return TextView(file_texts[piece.file].data, at, at + piece.length);
+        }
+        std::int64_t integer(std::uint32_t index) const { return int_table[index]; }
+        double number(std::uint32_t index) const { return float_table[index]; }
+        // every pool of this output, for -poolprint
+        std::vector<PoolUsage> pool_usage() const {
+            return {
+                token_pool.usage("tokens"), offset_pool.usage("offsets"), pool.usage("arena"), symbol_table.storage().usage("symbols"),
+                string_table.usage("strings"), int_table.usage("ints"), float_table.usage("floats"),
+                diagnostic_sink.usage("diagnostics"),
+            };
+        }
+        const RawPool& arena() const { return pool; }
+        // token range of every source, in the order they were given
+        std::span<const TokenRange> files() const { return file_ranges; }
+        // the source a token is in
+        std::uint32_t file_of(std::size_t token) const;
+
+        const Diagnostics& diagnostics() const { return diagnostic_sink; }
+        Diagnostics& diagnostics() { return diagnostic_sink; }
+
+        // appends the file of an output tokenized from that one source, as if
+        // it had been given to tokenize() after ours. symbols and payloads
+        // are remapped like the parallel lexer's shards are
+        void append(const LexOutput& unit);
+
+        // drops every token, symbol and string, keeping the memory
+        void reset() {
+            file_ranges = std::pmr::vector<TokenRange>(&pool); // before their memory is rewound
+            file_texts = std::pmr::vector<FileText>(&pool);
+            pool.reset();
+            token_pool.reset();
+            offset_pool.reset();
+            symbol_table.reset();
+            string_table.reset();
+            int_table.reset();
+            float_table.reset();
+            free_strings.reset();
+            free_ints.reset();
+            free_floats.reset();
+            diagnostic_sink.reset();
+            backing.reset();
+            read = 0;
+        }
+
+        // reads through the tokens, staying on the final _EOF
+        const Token& peek() const { return token_pool[read]; }
+        const Token& consume() {
+            const Token& tok = token_pool[read];
+            if (read + 1 < token_pool.size()) ++ read;
+            return tok;
+        }
+};
+
+inline Lexer::Lexer(LexOutput& out, const char* src, const char* stop, std::uint32_t offset, std::uint32_t file)
+    : out(out), src(src), stop(stop), origin(src), origin_offset(offset), file(file),
+      first_report(out.diagnostics().size()) {}
+
+#define TOKEN_RING_SIZE 256
+
+// lexes lazily into a fixed ring of tokens as they are peeked and consumed,
+// so tokens, payloads and the input buffer stay bounded however long the
+// source is. the symbol table and the diagnostics don't: every distinct
+// name and every report is kept for the whole run, symbol ids and report
+// offsets have to stay valid after their tokens are gone. reading from a
+// FILE* pulls input in as it's needed, the first token of a pipe shows up
+// before the writer is done. a token (and its payload) stays valid until
+// the ring is refilled, i.e. for at least the next TOKEN_RING_SIZE - 1
+// consume() calls
+class TokenStream {
+    LexOutput lex; // symbols, reports and payload tables, its token pool goes unused
+    Token ring[TOKEN_RING_SIZE];
+    int head = 0, tail = 0;
+
+    std::FILE* in = nullptr;
+    char* buf = nullptr;  // owned, only when reading from in
+    const char* cursor;   // where lexing resumes
+    std::uint32_t cursor_offset = 0; // its byte offset into the input
+    std::size_t buf_len = 0, buf_capacity = 0;
+    bool eof = false, done = false;
+
+    void fill();
+    // false at the end of in
+    bool read_more();
+
+    public:
+        // src has to outlive the stream
+        explicit TokenStream(const char* src): cursor(src), eof(true) {}
+        // doesn't close in
+        explicit TokenStream(std::FILE* in);
+        TokenStream(const TokenStream&) = delete;
+        ~TokenStream() { delete[] buf; }
+
+        const Token& peek() {
+            if (head == tail) fill();
+            return ring[head];
+        }
+
+        // keeps returning _EOF once there
+        const Token& consume() {
+            if (head == tail) fill();
+            return ring[head++];
+        }
+
+        const LexOutput& output() const { return lex; }
+};
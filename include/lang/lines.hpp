@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <lang/source.hpp>
+#include <lang/view.hpp>
+
+// 1-based, columns count bytes
+struct LineColumn { std::uint32_t line, column; };
+
+// where every line of one source starts. nothing is looked at until the first
+// query, which finds the newlines with the simd scanner, so a compile that
+// reports nothing never pays for it. lookups are a binary search
+class LineTable {
+    const char* text;
+    std::uint32_t length;
+    std::vector<std::uint32_t> starts; // starts[0] is 0, empty until built
+
+    void build();
+
+    public:
+        // source has to outlive the table
+        explicit LineTable(const SourceBuffer& source)
+            : text(source.data()), length((std::uint32_t)source.size()) {}
+
+        LineColumn locate(std::uint32_t offset);
+        std::size_t line_count();
+        // the text of a line, without its newline
+        TextView line(std::uint32_t line);
+};
+
+// a line table per source of a compilation, in the order they were given to
+// tokenize(), so a (file, offset) from a token or a diagnostic finds its line
+class SourceMap {
+    std::vector<LineTable> tables;
+
+    public:
+        explicit SourceMap(std::span<const SourceBuffer> sources) {
+            tables.reserve(sources.size());
+            for (const SourceBuffer& source : sources) tables.emplace_back(source);
+        }
+
+        LineColumn locate(std::size_t file, std::uint32_t offset) { return tables[file].locate(offset); }
+        LineTable& operator[](std::size_t file) { return tables[file]; }
+        std::size_t size() const { return tables.size(); }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <lang/cache.hpp>
+#include <lang/pool.hpp>
+#include <lang/source.hpp>
+
+// what a module's source is looked up as: "get a.b;" is a/b.dyt, and
+// "get "x.dyt";" is that path
+#define MODULE_EXTENSION ".dyt"
+
+class TaskPool;
+
+// one `get` of a module
+struct Import {
+    std::uint32_t module; // index into the graph
+    std::uint32_t node;   // the GET node, in the importer's tree
+};
+
+// one file of a build, compiled once however many modules get it
+struct Module {
+    std::string path; // canonical, what modules are told apart by
+    SourceBuffer source;
+    Unit unit;
+    std::vector<Import> imports; // in source order, resolved ones only
+    bool cached = false;         // the unit came from the cache
+};
+
+// the modules reachable from some roots through get. a module is compiled
+// as soon as the first get naming it is resolved, on a work-stealing pool:
+// each compile resolves its module's gets and spawns the ones nobody got
+// before, so a wide graph is soon compiling on every core. a name is looked
+// for next to the importer first, then in each search path in order.
+// problems (unresolvable gets, cycles) are reported to the importing unit
+class ModuleGraph {
+    std::vector<std::string> search;
+    const UnitCache* cache;
+    std::size_t max_depth;
+
+    Pool<Module> modules;
+    std::unordered_map<std::string, std::uint32_t> by_path;
+    std::vector<std::uint32_t> roots;
+    std::mutex lock; // of modules and by_path while building
+    std::atomic<std::size_t> cache_hits = 0;
+
+    // the module at path, added if it's new. true if it was
+    bool intern(const std::string& path, std::uint32_t& index);
+    Module& at(std::uint32_t index);
+    std::string resolve(Module& importer, const Node& get);
+    void compile_module(std::uint32_t index, TaskPool& tasks);
+    // every readable module, dependencies before their importers, roots in
+    // the order added. gets closing a cycle or naming an unreadable file are
+    // reported here
+    std::vector<std::uint32_t> order();
+
+    public:
+        explicit ModuleGraph(std::vector<std::string> search_paths, const UnitCache* cache = nullptr, std::size_t max_depth = PARSE_MAX_DEPTH);
+        ModuleGraph(const ModuleGraph&) = delete;
+
+        // false if path isn't a readable file
+        bool add_root(const char* path);
+
+        // compiles the roots and everything they get on jobs threads
+        void build(int jobs);
+
+        // joins the units, dependencies first, into program, moving out the
+        // sources (which program points into) and the paths in the same
+        // order. the graph's units are dropped
+        void link(Unit& program, std::vector<SourceBuffer>& sources, std::vector<std::string>& paths);
+
+        std::size_t size() const noexcept { return modules.size(); }
+        std::size_t cached() const noexcept { return cache_hits; }
+        const Module& operator[](std::uint32_t index) const { return modules[index]; }
+};
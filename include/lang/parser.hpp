@@ -1,148 +1,240 @@
-/*
 #pragma once
 
-#include <unordered_map>
-#define debug true
-
-#include <stdexcept>
-#include <string>
-
-#include "dlex.hpp"
-
-enum BinaryExprPayload {
-    // Binary Operations
-    _add, _sub, _div, _mul, _mod, _pow, _log, _concat,
-
-    // Bitwise Operations (excluding not)
-    _and, _or, _xor, _rsh, _lsh,
-
-    // Comparative Operations
-    _neq, _eq, _lt, _gt, _lteq, _gteq,
-    _if, _else, _func,
-
-    _idx, // a.b, a[b]
-
-    _bin_error // something wrong has happened
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <ranges>
+#include <vector>
+
+#include <lang/diagnostics.hpp>
+#include <lang/dlex.hpp>
+#include <lang/pool.hpp>
+
+// every node kind as (NodeKind, name), in enum order
+// a node is one of three shapes, see Node
+#define DOYT_NODES(X) \
+    X(ERROR, "error")     /* what a syntax error left, token is where */ \
+    X(LITERAL, "literal") /* its token has the code and payload */ \
+    X(NAME, "name")       /* token is the identity */ \
+    X(UNARY, "unary")     /* op a */ \
+    X(BINARY, "binary")   /* a op b */ \
+    X(ASSIGN, "assign")   /* a = b */ \
+    X(INDEX, "index")     /* a[b] */ \
+    X(MEMBER, "member")   /* a.b, b is a NAME */ \
+    X(CALL, "call")       /* list: callee, args... */ \
+    X(ARRAY, "array")     /* list: items... */ \
+    X(SEQ, "seq")         /* list: a = 1, b = 2; */ \
+    X(BLOCK, "block")     /* list: statements... */ \
+    X(IF, "if")           /* list: cond, then, else? */ \
+    X(WHILE, "while")     /* a cond, b body */ \
+    X(FOR, "for")         /* list: header..., body */ \
+    X(RET, "return")      /* a value, may be NO_NODE */ \
+    X(BREAK, "break")     \
+    X(CONTINUE, "continue") \
+    X(GET, "get")         /* a module */ \
+    X(PARAM, "param")     /* a type, may be NO_NODE, b name */ \
+    X(FUNC, "func")       /* list: return type or NO_NODE, name, params..., body */ \
+    X(SOURCE, "source")   /* list: statements of one file */ \
+    X(PROGRAM, "program") /* list: sources */
+
+enum class NodeKind : std::uint8_t {
+#define NODE(kind, name) kind,
+    DOYT_NODES(NODE)
+#undef NODE
 };
 
-enum LiteralExprPayload {
-    // literals
-    _litfloat, _litbool, // dont bother with litbool for now (im not even lexxing it </3)
-    _litstr,
-
-    _error // something wrong has happened
-
+// operator payloads of UNARY and BINARY nodes, as (Op, spelling)
+#define DOYT_OPS(X) \
+    X(NONE, "")   \
+    X(ADD, "+")   X(SUB, "-")   X(MUL, "*")   X(DIV, "/") \
+    X(EQ, "==")   X(NEQ, "!=")  X(LT, "<")    X(GT, ">")  X(LTEQ, "<=") X(GTEQ, ">=") \
+    X(SHL, "<<")  X(SHR, ">>")  \
+    X(NEG, "-")   X(NOT, "!")
+
+enum class Op : std::uint8_t {
+#define OP(op, text) op,
+    DOYT_OPS(OP)
+#undef OP
 };
 
-enum UnaryExprPayload {
-    _neg, _not, _exp, _ln, _abs, _flr, _sqrt,
+#define NO_NODE (~std::uint32_t(0))
 
-    _unary_error // something wrong has happened
-};
+// 16 bytes, no vtable, nothing on the heap. a node refers to its children by
+// index into Ast::nodes, and list nodes to a range [a, a + b) of Ast::lists.
+// children are always emitted before their parent, so the node array is the
+// tree in post-order and a bottom-up pass is a plain loop over it
+struct Node {
+    NodeKind kind;
+    Op op = Op::NONE;                // operator of UNARY/BINARY
+    std::uint32_t token = 0;         // the operator, keyword or literal it came from
+    std::uint32_t a = NO_NODE, b = NO_NODE;
 
-class parser_error : public std::runtime_error {
-public:
-    parser_error(const std::string& message) 
-        : std::runtime_error(message) {}
-    
-    parser_error(const char* message) 
-        : std::runtime_error(message) {}
+    bool is_list() const noexcept;
 };
-
-enum class ExprType { Binary, Unary, Literal, Identifier, Call };
-
-struct Expr {
-    ExprType kind;
-    virtual ~Expr() = default;
+static_assert(sizeof(Node) == 16);
+
+const char* node_name(NodeKind kind) noexcept;
+const char* op_text(Op op) noexcept;
+
+// flat syntax tree of one LexOutput, which it indexes into and must outlive it
+class Ast {
+    friend class Parser;
+    friend class UnitCache;
+    Pool<Node> node_pool;
+    Pool<std::uint32_t> list_pool; // children of list nodes, node indices
+    std::uint32_t root_node = NO_NODE;
+    std::shared_ptr<const void> backing; // what borrowed pools point into, see UnitCache
+
+    public:
+        std::size_t size() const { return node_pool.size(); }
+        const Node& operator[](std::uint32_t index) const { return node_pool[index]; }
+        // post-order, see Node
+        const Pool<Node>& nodes() const { return node_pool; }
+        // the PROGRAM node, last in nodes()
+        std::uint32_t root() const { return root_node; }
+
+        // node indices of a list node's children
+        auto list(const Node& node) const {
+            return std::views::iota(node.a, node.a + node.b)
+                | std::views::transform([this](std::uint32_t i) { return list_pool[i]; });
+        }
+
+        std::vector<PoolUsage> pool_usage() const {
+            return { node_pool.usage("nodes"), list_pool.usage("lists") };
+        }
+
+        // drops every node, keeping the memory
+        void reset() {
+            node_pool.reset();
+            list_pool.reset();
+            root_node = NO_NODE;
+            backing.reset();
+        }
+
+        // appends the SOURCE of a tree parsed from a one-file output, whose
+        // tokens start at token_base of ours (see LexOutput::append). the
+        // PROGRAM node is made again, so the tree is what parsing it all
+        // together would have given
+        void append(const Ast& unit, std::uint32_t token_base);
+
+        // indented, one node per line
+        std::ostream& print(std::ostream& stream, const LexOutput& lex) const;
 };
 
-struct BinaryExpr : Expr {
-    Expr* left;
-    Expr* right;
-    BinaryExprPayload op;
-};
-
-struct UnaryExpr : Expr {
-    UnaryExprPayload op;
-    Expr* operand;
-};
-
-struct LiteralExpr : Expr {
-    LiteralExprPayload type;
-    dTPayload value;
-};
-
-struct IdentifierExpr : Expr {
-    std::string name;
-};
-
-struct CallExpr : Expr {
-    IdentifierExpr* fn;
-    std::vector<Expr*> args;
-};
-
-std::string AST_to_str(Expr* root, int indent = 0);
-
-enum class TypeKind {
-    _float, _bool, _string,
-    _struct, _array, _function,
-    _pointer // ? 
-};
-
-struct StructField; // forward decl.
-
-struct Type {
-    TypeKind kind;
-    union {
-        struct {
-            std::vector<StructField>* fields;          
-        } struct_info;
-        struct {
-            Type* element_type;
-            size_t size;
-        } array_info;
-        struct {
-            Type* target_type;
-        } ptr_info;
-    };
-};
-
-struct StructField {
-    std::string name;
-    Type type;
-};
-
-template <typename T>
-concept DerivedFromExpr = std::is_base_of_v<Expr, T>;
-
+// nesting the parser takes before it reports an error and skips the rest, on
+// expressions (kept on the heap) and on statements (on the native stack) alike
+#define PARSE_MAX_DEPTH 10000
+
+// pratt parser over the tokens of a LexOutput, every file is parsed into a
+// SOURCE node of its own. expressions are parsed without recursion, their
+// pending operators live on an explicit stack, so nesting costs heap memory
+// in proportion to its depth instead of native stack.
+// nothing throws, a syntax error is reported, leaves an ERROR node and the
+// parser resyncs at the next ';', '}' or statement keyword, so one pass finds
+// every error. what follows an error until then isn't reported
 class Parser {
-private:
-    std::unordered_map<std::string, Type> type_registry; // holds all the types that have been seen so far
-    // also holds all the primitives like float at the beginning
-
-    LexOutput lex;
-    Arena arena;
-
-    
-    Expr* nud(Token op);
-    Expr* led(Token op, Expr* left);
-    
-public:    
-    // // ASTNode* alloc_node();
-    // BinaryExpr* alloc_bin_expr();
-    // UnaryExpr* alloc_unary_expr();
-    // LiteralExpr* alloc_literal_expr();
-    // IdentifierExpr* alloc_identifier_expr();
-
-    template <DerivedFromExpr T>
-    T* alloc_expr();
-
-    Expr* parse_statement();
-    Expr* parse_expression(float min_bp = 0);
-
-    Expr* parse_whole();
+    // what an operand on the stack is waiting for
+    enum class Pending : std::uint8_t { DONE, UNARY, BINARY, ASSIGN, GROUP, INDEX, CALL, ARRAY };
+
+    struct Frame {
+        Pending pending;
+        std::uint8_t min_bp;            // what binds tighter goes into the operand
+        Op op = Op::NONE;
+        std::uint32_t token = 0;
+        std::uint32_t left = NO_NODE;   // left operand of BINARY/ASSIGN/INDEX
+        std::uint32_t mark = 0;         // where CALL/ARRAY items start in scratch
+    };
 
-    Parser(LexOutput lex_output);
+    const LexOutput& lex;
+    Ast& ast;
+    Diagnostics& diags;
+    bool panic = false;    // an error was reported, and we haven't resynced since
+    bool overflow = false; // the expression went past max_depth
+    // tokens are read in place through the pool's iterator, never copied
+    Pool<Token>::const_iterator first, cursor, stop; // first token of the output, next one, end of the current file
+    std::uint32_t last = 0;                          // index of the token consume() returned
+    std::uint32_t file_first = 0;                    // index of the current file's first token
+    std::uint32_t file = 0;                          // and of the file, for reports
+    // children of the lists being built, moved to ast.lists once complete
+    std::vector<std::uint32_t> scratch;
+    // the expression being parsed, top is its last frame. frames only grows,
+    // up to max_depth, so a warm parser doesn't allocate
+    std::vector<Frame> frames;
+    Frame* top = nullptr;
+    Frame* frames_end = nullptr;
+    std::size_t max_depth;
+    std::size_t nesting = 0;   // statements we're in
+
+    static constexpr Token eof{};
+
+    std::uint32_t position() const { return (std::uint32_t)(cursor - first); }
+    // _EOF past the end of the current file
+    const Token& peek() const { return cursor != stop ? *cursor : eof; }
+    const Token& consume() {
+        last = position();
+        if (cursor == stop) return eof;
+        return *cursor++;
+    }
+    // consume() for a token peek() showed isn't the eof
+    void skip() {
+        last = position();
+        ++cursor;
+    }
+    // where a report about the next token points, the last one at the end of a file
+    std::uint32_t here() const { return cursor != stop || last < file_first ? position() : last; }
+    bool accept(TokenCode code) {
+        if (peek().code() != code) return false;
+        consume();
+        return true;
+    }
+    // consumes code, or reports diag with what was found instead (after,
+    // if given, comes first in its arguments)
+    bool expect(TokenCode code, DiagCode diag, TokenCode after = TokenCode::_EOF);
+    void error(DiagCode code, std::uint32_t token, std::uint32_t arg0 = 0, std::uint32_t arg1 = 0);
+    // skips to the start of the next statement, at least one token past from
+    void synchronize(std::uint32_t from);
+    // the rest of an expression that went too deep
+    std::uint32_t abandon(std::size_t mark);
+
+    std::uint32_t node(NodeKind kind, std::uint32_t token, std::uint32_t a = NO_NODE, std::uint32_t b = NO_NODE, Op op = Op::NONE);
+    // a list node of scratch[mark...], which is popped
+    std::uint32_t list(NodeKind kind, std::uint32_t token, std::size_t mark);
+
+    // false past max_depth, with overflow set
+    bool push(const Frame& frame) {
+        if (top + 1 == frames_end && !grow()) return false;
+        *++top = frame;
+        return true;
+    }
+    bool grow();
+    // each either leaves a finished operand of the top frame in value (true)
+    // or pushes a frame that is still waiting for one
+    bool nud(std::uint32_t& value);
+    std::uint32_t missing_operand(); // an ERROR node where nud found nothing
+    bool led(const Token& op, std::uint32_t& value);
+    // value is the finished operand of the top frame, which is popped,
+    // false if the frame wants another one (the next item of a list)
+    bool reduce(std::uint32_t& value);
+    // comma separated expressions into scratch until close, which is consumed
+    void parse_items(TokenCode close, DiagCode diag, TokenCode after);
+
+    std::uint32_t parse_block();
+    std::uint32_t parse_func();
+    std::uint32_t parse_file(TokenRange range);
+
+    public:
+        Parser(const LexOutput& lex, Ast& into, Diagnostics& diags, std::size_t max_depth = PARSE_MAX_DEPTH)
+            : lex(lex), ast(into), diags(diags), first(lex.tokens().begin()), cursor(first), stop(first), max_depth(max_depth) {}
+
+        std::uint32_t parse_expression(int min_bp = 0);
+        std::uint32_t parse_statement();
+        // every file of the output, returns the root
+        std::uint32_t parse_whole();
 };
 
-*/
\ No newline at end of file
+// syntax errors are reported to diags (usually the output's own), the tree is
+// always complete, with ERROR nodes where they were
+Ast parse(const LexOutput& lex, Diagnostics& diags, std::size_t max_depth = PARSE_MAX_DEPTH);
+// same, into an ast that is reset first and keeps its memory, false if
+// anything was reported
+bool parse(Ast& into, const LexOutput& lex, Diagnostics& diags, std::size_t max_depth = PARSE_MAX_DEPTH);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// hardware counters around a phase, through perf_event_open where the kernel
+// allows it (linux, perf_event_paranoid <= 2 for user space counts). counters
+// that can't be opened read as -1, the rest still work. counts include every
+// thread started while counting, so -j lexing is measured as a whole
+class PerfCounters {
+    public:
+        enum Counter { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, LLC_MISSES, COUNTER_COUNT };
+
+    private:
+        int fds[COUNTER_COUNT];
+        std::int64_t values[COUNTER_COUNT];
+        int error = 0; // errno of the first counter that failed to open
+
+    public:
+        PerfCounters();
+        PerfCounters(const PerfCounters&) = delete;
+        ~PerfCounters();
+
+        // at least one counter opened
+        bool available() const noexcept;
+        // why the first failing counter didn't open, "" if none failed
+        const char* why() const noexcept;
+
+        void start() noexcept;
+        void stop() noexcept;
+
+        // scaled for multiplexing, -1 if unavailable
+        std::int64_t operator[](Counter counter) const noexcept { return values[counter]; }
+        static const char* name(Counter counter) noexcept;
+};
@@ -1,54 +1,192 @@
 #pragma once
+#include <algorithm>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory_resource>
+#include <new>
+#include <ranges>
+#include <span>
+#include <type_traits>
 #include <utility>
 
-#define DEFAULT_POOL_CAPACITY 1024 
+#define DEFAULT_POOL_CAPACITY 1024
 // matched to 1 KiB for RawPool
+// blocks grow geometrically from there, block k holds DEFAULT_POOL_CAPACITY << k
+// items (or bytes), so a pool never needs more than POOL_MAX_BLOCKS of them
+#define POOL_MAX_BLOCKS 40
+// every block starts on this boundary
+#define POOL_BLOCK_ALIGN 64
 
-class RawPool {
-    struct PoolBlock { 
-        char* buf = nullptr; 
-        unsigned int cur = 0, len = 0;
+static_assert(std::has_single_bit((unsigned)DEFAULT_POOL_CAPACITY), "pool indexing needs a power of two");
 
-        PoolBlock() = default;
-        PoolBlock(const unsigned int B): buf(new char[B]), len(B) {}
-        unsigned int available() const { return len - cur; }
+// per pool, in blocks
+struct PoolStats {
+    std::size_t allocated = 0; // fresh from the system
+    std::size_t reused = 0;    // kept over a reset or taken from the block cache
+    std::size_t released = 0;  // handed back by a trim or the destructor
+};
+
+// a snapshot of one pool, for -poolprint
+struct PoolUsage {
+    const char* name = "";
+    unsigned int blocks = 0;
+    std::size_t reserved = 0; // bytes held
+    std::size_t used = 0;     // bytes handed out
+    std::size_t wasted = 0;   // bytes left at the ends of blocks that were moved past
+    PoolStats stats;          // every block taken is a growth event
+};
+
+// process-wide free-list of pool blocks, off until enabled. pools hand their
+// blocks back on trim and destruction and borrow them again before asking the
+// system, so a tool that keeps compiling similar units stops allocating once
+// warm. blocks are kept per exact size, pool block sizes repeat anyway
+namespace block_cache {
+    // caches at most max_bytes, what doesn't fit is freed
+    void enable(std::size_t max_bytes = std::size_t(256) << 20);
+    // frees everything cached and stops caching
+    void disable();
+    bool enabled() noexcept;
+    std::size_t cached_bytes() noexcept;
+
+    // a POOL_BLOCK_ALIGN aligned block of bytes, reused tells where it came from
+    void* acquire(std::size_t bytes, bool& reused);
+    void release(void* block, std::size_t bytes) noexcept;
+}
+
+// bump allocator over geometric blocks, also usable as a std::pmr resource
+// so front-end containers can draw from the same arena. deallocation is a
+// no-op, everything goes at once on reset or destruction
+class RawPool : public std::pmr::memory_resource {
+    struct PoolBlock {
+        char* buf = nullptr;
+        std::size_t cur = 0, len = 0;
+
+        std::size_t available() const { return len - cur; }
     };
 
-    PoolBlock* blocks;
-    short count = 1, capacity = 1;
-
-    // gets the top pointer, may create new block if needed
-    template <typename T> T* _top() {
-        if (sizeof(T) > blocks[count-1].available()) {
-            PoolBlock* old_blocks = blocks;
-            capacity <<= 1;
-            blocks = new PoolBlock[capacity];
-            for (int i = 0; i < count; i++) blocks[i] = old_blocks[i];
-            blocks[count++] = PoolBlock(DEFAULT_POOL_CAPACITY);
-            delete[] old_blocks;
-        }
-        PoolBlock& top = blocks[count-1];
-        T* ptr = (T*)(top.buf + top.cur);
-        top.cur += sizeof(T);
+    PoolBlock blocks[POOL_MAX_BLOCKS];
+    unsigned int count = 0; // blocks held
+    unsigned int used = 0;  // blocks handed out from, the last one is the top
+    std::size_t last_high = 0; // bytes used before the last reset
+    PoolStats _stats;
+
+    static std::size_t padding(const PoolBlock& block, std::size_t align) noexcept {
+        return -(std::uintptr_t)(block.buf + block.cur) & (align - 1);
+    }
+
+    // gets the top pointer, aligned to align, may move on to the next block
+    // if needed. oversized requests get a block of at least their own size
+    char* _top(std::size_t size, std::size_t align = 1) {
+        std::size_t pad = used ? padding(blocks[used-1], align) : 0;
+        if (!used || pad + size > blocks[used-1].available()) {
+            // blocks start POOL_BLOCK_ALIGN aligned, only bigger alignments need room to pad
+            next_block(size + (align > POOL_BLOCK_ALIGN ? align : 0));
+            pad = padding(blocks[used-1], align);
+        }
+        PoolBlock& top = blocks[used-1];
+        char* ptr = top.buf + top.cur + pad;
+        top.cur += pad + size;
         return ptr;
     }
 
+    template <typename T> T* _top() { return (T*)_top(sizeof(T), alignof(T)); }
+
+    void next_block(std::size_t size) {
+        // a kept block too small for this is given back with the ones after it
+        if (used < count && blocks[used].len < size) release_from(used);
+        if (used < count) {
+            ++ _stats.reused;
+        } else {
+            std::size_t len = (std::size_t)DEFAULT_POOL_CAPACITY << count;
+            if (size > len) len = size;
+            bool reused;
+            blocks[count++] = { (char*)block_cache::acquire(len, reused), 0, len };
+            ++ (reused ? _stats.reused : _stats.allocated);
+        }
+        blocks[used++].cur = 0;
+    }
+
+    void release_from(unsigned int k) noexcept {
+        for (unsigned int i = k; i < count; i++) {
+            block_cache::release(blocks[i].buf, blocks[i].len);
+            blocks[i] = {};
+            ++ _stats.released;
+        }
+        if (count > k) count = k;
+    }
+
     public:
-        PoolBlock operator[](short i) {
-            return blocks[i];
+        // the used bytes of block i
+        std::span<char> block(unsigned int i) const { return { blocks[i].buf, blocks[i].cur }; }
+
+        unsigned int block_count() const noexcept { return used; }
+
+        // every block's used bytes as a span
+        auto blocks_view() const noexcept {
+            return std::views::iota(0u, used) | std::views::transform([this](unsigned int i) { return block(i); });
+        }
+        // every used byte, block after block. single pass only, the
+        // spans are made on the fly so the join can't be walked twice
+        auto bytes() const noexcept { return blocks_view() | std::views::join; }
+
+        std::size_t used_bytes() const noexcept {
+            std::size_t n = 0;
+            for (unsigned int i = 0; i < used; i++) n += blocks[i].cur;
+            return n;
+        }
+        std::size_t reserved_bytes() const noexcept {
+            std::size_t n = 0;
+            for (unsigned int i = 0; i < count; i++) n += blocks[i].len;
+            return n;
+        }
+        const PoolStats& stats() const noexcept { return _stats; }
+
+        PoolUsage usage(const char* name) const noexcept {
+            PoolUsage u { name, used, reserved_bytes(), used_bytes(), 0, _stats };
+            for (unsigned int i = 0; i + 1 < used; i++) u.wasted += blocks[i].available();
+            return u;
         }
+        // bytes left at the end of block i, only final once it's been moved past
+        std::size_t tail(unsigned int i) const noexcept { return blocks[i].available(); }
 
-        short block_count() const noexcept { return count; }
+        // rewinds every block and keeps enough of them for the larger of this
+        // and the previous fill, so a one-off spike doesn't pin its memory
+        void reset() noexcept {
+            std::size_t high = used_bytes();
+            used = 0;
+            trim(high > last_high ? high : last_high);
+            last_high = high;
+            for (unsigned int i = 0; i < count; i++) blocks[i].cur = 0;
+        }
 
-        RawPool(): blocks(new PoolBlock[1]) {
-            blocks[0] = PoolBlock(DEFAULT_POOL_CAPACITY);
+        // gives back the blocks not needed to hold keep bytes, never ones in
+        // use and never the first
+        void trim(std::size_t keep) noexcept {
+            std::size_t held = 0;
+            unsigned int k = count ? 1 : 0;
+            if (k) held = blocks[0].len;
+            while (k < count && (k < used || held < keep)) held += blocks[k++].len;
+            release_from(k);
         }
 
-        ~RawPool() {
-            for (int i = 0; i < count; i++) delete[] blocks[i].buf;
-            delete[] blocks;
+        RawPool() = default;
+        RawPool(const RawPool&) = delete;
+        RawPool(RawPool&& other) noexcept
+            : count(other.count), used(other.used), last_high(other.last_high), _stats(other._stats) {
+            for (unsigned int i = 0; i < count; i++) blocks[i] = other.blocks[i];
+            other.count = other.used = 0;
         }
 
+        ~RawPool() { release_from(0); }
+
+        // uninitialised bytes, e.g. for interned text. hides the pmr allocate,
+        // whose default alignment is wasted on text
+        char* allocate(std::size_t size, std::size_t align = 1) { return _top(size, align); }
+
         template <typename T, typename... args> T* emplace(args&&... params) {
             return new (_top<T>()) T(std::forward<args>(params)...);
         }
@@ -56,72 +194,355 @@ class RawPool {
         template <typename T> T* append(const T& item) {
             return new (_top<T>()) T(item);
         }
+
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t align) override { return _top(bytes, align); }
+        void do_deallocate(void*, std::size_t, std::size_t) override {}
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
 };
 
+// items never move once placed, unless spliced. block k starts at slot
+// DEFAULT_POOL_CAPACITY * (2^k - 1), so indexing is a bit scan and a shift.
+// a splice leaves a gap of free slots where it worked, items from the gap on
+// sit gap_len slots further up than their index
 template <typename T> class Pool {
-    struct PoolBlock { 
-        T* buf = nullptr; 
-        unsigned int cur = 0, len = 0;
-        
-        PoolBlock() = default;
-        PoolBlock(const unsigned int size): buf(new T[size]), len(size) {}
-        unsigned int available() const noexcept { return len - cur; }
-    };
+    static constexpr unsigned int SHIFT = std::countr_zero((unsigned)DEFAULT_POOL_CAPACITY);
 
-    class PoolIterator {
+    static constexpr std::size_t block_len(unsigned int k) { return (std::size_t)DEFAULT_POOL_CAPACITY << k; }
+    // index of the first item in block k
+    static constexpr std::size_t block_start(unsigned int k) { return block_len(k) - DEFAULT_POOL_CAPACITY; }
+    static constexpr unsigned int block_of(std::size_t i) { return std::bit_width((i >> SHIFT) + 1) - 1; }
+
+    static_assert(alignof(T) <= POOL_BLOCK_ALIGN, "over-aligned pool item");
+
+    // non-owning random access iterator. walks a block through a cached
+    // pointer and only redoes the index math when crossing into the next one
+    template <bool Const> class PoolIterator {
         friend Pool;
-        // only use if done with making pool
-        PoolBlock* block; short block_index, block_count;
-        int index, gap;
-        
-        PoolIterator(Pool pool): block(pool.blocks), block_index(0), block_count(pool.count), index(0), gap(pool.blocks->cur) {}
+        friend PoolIterator<!Const>;
+        using PoolRef = std::conditional_t<Const, const Pool, Pool>;
+
+        PoolRef* pool = nullptr;
+        std::size_t index = 0;
+        T* ptr = nullptr;
+        T* block_end = nullptr;
+
+        void seek(std::size_t i) noexcept {
+            index = i;
+            std::size_t slot = pool->slot_of(i);
+            unsigned int k = block_of(slot);
+            T* buf = k < POOL_MAX_BLOCKS ? pool->blocks[k] : nullptr;
+            ptr = buf ? buf + (slot - block_start(k)) : nullptr;
+            block_end = buf ? buf + block_len(k) : nullptr;
+            // the run stops short where the gap starts
+            if (buf && i < pool->gap_at && pool->gap_at < block_start(k) + block_len(k)) block_end = buf + (pool->gap_at - block_start(k));
+        }
+
+        PoolIterator(PoolRef& pool, std::size_t i) noexcept: pool(&pool) { seek(i); }
+
         public:
-            T peek() const noexcept { return block->buf[index]; }
-            T consume() noexcept {
-              T current = block->buf[index++];
-              if (index == gap && block_index+1 < block_count) {
-                block++;
-                index = 0;
-                gap = block->cur;
-                ++block_index;
-              }
-              return current;
+            using iterator_concept = std::random_access_iterator_tag;
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const T*, T*>;
+            using reference = std::conditional_t<Const, const T&, T&>;
+
+            PoolIterator() = default;
+            // iterator -> const_iterator
+            template <bool Other> requires (Const && !Other)
+            PoolIterator(const PoolIterator<Other>& other) noexcept
+                : pool(other.pool), index(other.index), ptr(other.ptr), block_end(other.block_end) {}
+
+            reference operator*() const noexcept { return *ptr; }
+            pointer operator->() const noexcept { return ptr; }
+            reference operator[](difference_type n) const noexcept { return (*pool)[index + n]; }
+
+            PoolIterator& operator++() noexcept {
+                ++ index;
+                if (++ptr == block_end) seek(index);
+                return *this;
+            }
+            PoolIterator operator++(int) noexcept { PoolIterator it = *this; ++*this; return it; }
+            PoolIterator& operator--() noexcept { seek(index - 1); return *this; }
+            PoolIterator operator--(int) noexcept { PoolIterator it = *this; --*this; return it; }
+
+            PoolIterator& operator+=(difference_type n) noexcept { seek(index + n); return *this; }
+            PoolIterator& operator-=(difference_type n) noexcept { seek(index - n); return *this; }
+            friend PoolIterator operator+(PoolIterator it, difference_type n) noexcept { return it += n; }
+            friend PoolIterator operator+(difference_type n, PoolIterator it) noexcept { return it += n; }
+            friend PoolIterator operator-(PoolIterator it, difference_type n) noexcept { return it -= n; }
+            friend difference_type operator-(const PoolIterator& a, const PoolIterator& b) noexcept {
+                return (difference_type)a.index - (difference_type)b.index;
             }
-            bool has_next() const noexcept { return (index < gap) && (block_index < block_count); }
+
+            friend bool operator==(const PoolIterator& a, const PoolIterator& b) noexcept { return a.index == b.index; }
+            friend auto operator<=>(const PoolIterator& a, const PoolIterator& b) noexcept { return a.index <=> b.index; }
     };
-    friend PoolIterator;
 
-    PoolBlock* blocks;
-    short count = 1, capacity = 1;
+    T* blocks[POOL_MAX_BLOCKS] = {};
+    std::size_t count = 0;
+    std::size_t gap_at = 0, gap_len = 0; // the gap's first slot and its size, see splice()
+    T* top = nullptr;
+    T* top_end = nullptr;
+    std::size_t last_high = 0; // items held before the last reset
+    bool borrowed = false;     // the blocks are someone else's memory, see borrow()
+    PoolStats _stats;
+
+    // slots up to the last item, the gap among them
+    std::size_t used() const noexcept { return count + gap_len; }
+    std::size_t slot_of(std::size_t i) const noexcept { return i < gap_at ? i : i + gap_len; }
+    T& slot(std::size_t i) const noexcept {
+        unsigned int k = block_of(i);
+        return blocks[k][i - block_start(k)];
+    }
+    // top after the last item moved down
+    void retop() noexcept {
+        unsigned int k = block_of(used());
+        top = blocks[k] ? blocks[k] + (used() - block_start(k)) : nullptr;
+        top_end = blocks[k] ? blocks[k] + block_len(k) : nullptr;
+    }
 
     // unlike RawPool, not likely to see discarded space here
     T* _top() {
-        if (!blocks[count-1].available()) {
-            PoolBlock* old_blocks = blocks;
-            capacity <<= 1;
-            blocks = new PoolBlock[capacity];
-            for (int i = 0; i < count; i++) blocks[i] = old_blocks[i];
-            blocks[count++] = PoolBlock(DEFAULT_POOL_CAPACITY);
-            delete[] old_blocks;
+        if (top == top_end && borrowed) own(); // which may leave room in the last block
+        if (top == top_end) {
+            unsigned int k = block_of(used());
+            if (blocks[k]) {
+                ++ _stats.reused;
+            } else {
+                bool reused;
+                blocks[k] = static_cast<T*>(block_cache::acquire(block_len(k) * sizeof(T), reused));
+                ++ (reused ? _stats.reused : _stats.allocated);
+            }
+            top = blocks[k];
+            top_end = top + block_len(k);
+        }
+        ++ count;
+        return top++;
+    }
+
+    // copies borrowed items into blocks of our own
+    void own() {
+        T* mine[POOL_MAX_BLOCKS] = {};
+        for (unsigned int k = 0; k < block_count(); k++) {
+            bool reused;
+            mine[k] = static_cast<T*>(block_cache::acquire(block_len(k) * sizeof(T), reused));
+            ++ (reused ? _stats.reused : _stats.allocated);
+            std::memcpy((void*)mine[k], blocks[k], block(k).size() * sizeof(T));
+        }
+        std::copy(std::begin(mine), std::end(mine), blocks);
+        borrowed = false;
+        top = top_end = nullptr;
+        if (!used()) return;
+        unsigned int k = block_of(used() - 1);
+        top = blocks[k] + (used() - block_start(k));
+        top_end = blocks[k] + block_len(k);
+    }
+
+    void release_from(unsigned int k) noexcept {
+        if (borrowed) {
+            for (; k < POOL_MAX_BLOCKS; k++) blocks[k] = nullptr;
+            return;
+        }
+        for (; k < POOL_MAX_BLOCKS && blocks[k]; k++) {
+            block_cache::release(blocks[k], block_len(k) * sizeof(T));
+            blocks[k] = nullptr;
+            ++ _stats.released;
         }
+    }
+
+    // moves len slots from slot from to slot to, a contiguous run at a time.
+    // back to front when moving up, so overlapping ranges come out right
+    void move_slots(std::size_t from, std::size_t to, std::size_t len) noexcept {
+        auto room = [](std::size_t i) { unsigned int k = block_of(i); return block_start(k) + block_len(k) - i; };
+        auto before = [](std::size_t i) { return i - block_start(block_of(i)) + 1; }; // items up to i in its block
+        if (to < from) {
+            for (std::size_t i = 0; i < len;) {
+                std::size_t n = std::min({ len - i, room(from + i), room(to + i) });
+                std::memmove((void*)&slot(to + i), &slot(from + i), n * sizeof(T));
+                i += n;
+            }
+        } else if (to > from) {
+            for (std::size_t e = len; e;) {
+                std::size_t n = std::min({ e, before(from + e - 1), before(to + e - 1) });
+                e -= n;
+                std::memmove((void*)&slot(to + e), &slot(from + e), n * sizeof(T));
+            }
+        }
+    }
 
-        PoolBlock& top = blocks[count-1];
-        return top.buf + top.cur++;
+    // the items between the gap and index at cross it, so the gap starts at at
+    void move_gap(std::size_t at) noexcept {
+        if (at < gap_at) move_slots(at, at + gap_len, gap_at - at);
+        else if (at > gap_at) move_slots(gap_at + gap_len, gap_at, at - gap_at);
+        gap_at = at;
+    }
+
+    // n more free slots in the gap, the items after it move up
+    void grow_gap(std::size_t n) {
+        std::size_t after = used() - gap_at - gap_len;
+        for (std::size_t i = 0; i < n; i++) _top();
+        count -= n;
+        move_slots(gap_at + gap_len, gap_at + gap_len + n, after);
+        gap_len += n;
+    }
+
+    std::span<T> run_of(std::size_t i, std::size_t end) const noexcept {
+        std::size_t at = slot_of(i);
+        unsigned int k = block_of(at);
+        std::size_t n = block_start(k) + block_len(k) - at;
+        if (i < gap_at && gap_at - i < n) n = gap_at - i;
+        return { &slot(at), end - i < n ? end - i : n };
+    }
+
+    void destroy_items() {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (std::size_t i = 0; i < count; i++) (*this)[i].~T();
+        }
     }
 
     public:
-        PoolIterator iterator() const { return PoolIterator(*this); }
-        PoolBlock operator[](short i) {
-            return blocks[i];
+        using iterator = PoolIterator<false>;
+        using const_iterator = PoolIterator<true>;
+
+        iterator begin() noexcept { return iterator(*this, 0); }
+        iterator end() noexcept { return iterator(*this, count); }
+        const_iterator begin() const noexcept { return const_iterator(*this, 0); }
+        const_iterator end() const noexcept { return const_iterator(*this, count); }
+
+        T& operator[](std::size_t i) noexcept { return slot(slot_of(i)); }
+        const T& operator[](std::size_t i) const noexcept { return slot(slot_of(i)); }
+
+        std::size_t size() const noexcept { return count; }
+
+        // blocks holding items
+        unsigned int block_count() const noexcept { return used() ? block_of(used() - 1) + 1 : 0; }
+
+        // the slots of block k up to the last item, contiguous. the gap of a
+        // spliced pool is among them, walk it with run() instead
+        std::span<T> block(unsigned int k) noexcept {
+            std::size_t n = used() - block_start(k);
+            return { blocks[k], n < block_len(k) ? n : block_len(k) };
+        }
+        std::span<const T> block(unsigned int k) const noexcept {
+            std::size_t n = used() - block_start(k);
+            return { blocks[k], n < block_len(k) ? n : block_len(k) };
+        }
+
+        // the contiguous items from i on, up to end, the end of i's block or the gap
+        std::span<T> run(std::size_t i, std::size_t end) noexcept { return run_of(i, end); }
+        std::span<const T> run(std::size_t i, std::size_t end) const noexcept { return run_of(i, end); }
+
+        // every used block as a contiguous span, for tight loops over the items
+        auto blocks_view() noexcept {
+            return std::views::iota(0u, block_count()) | std::views::transform([this](unsigned int k) { return block(k); });
+        }
+        auto blocks_view() const noexcept {
+            return std::views::iota(0u, block_count()) | std::views::transform([this](unsigned int k) { return block(k); });
+        }
+
+        std::size_t reserved() const noexcept {
+            std::size_t n = 0;
+            for (unsigned int k = 0; k < POOL_MAX_BLOCKS && blocks[k]; k++) n += block_len(k);
+            return n;
+        }
+        const PoolStats& stats() const noexcept { return _stats; }
+
+        // items fill their blocks exactly, nothing is wasted
+        PoolUsage usage(const char* name) const noexcept {
+            return { name, block_count(), reserved() * sizeof(T), count * sizeof(T), 0, _stats };
+        }
+
+        // takes n items in place, from memory that has to outlive the pool and
+        // stay writable (a private mapping is). the block layout is one run of
+        // items, so any array can be borrowed. the first insert past them
+        // copies them into blocks of the pool's own
+        void borrow(T* items, std::size_t n) noexcept {
+            static_assert(std::is_trivially_copyable_v<T>, "only plain items can be borrowed");
+            reset();
+            release_from(0);
+            for (unsigned int k = 0; k < POOL_MAX_BLOCKS && block_start(k) < n; k++) blocks[k] = items + block_start(k);
+            count = n;
+            gap_at = gap_len = 0;
+            borrowed = true;
+            top = top_end = nullptr;
+        }
+
+        // drops the last item, its block stays
+        void pop_back() {
+            if (borrowed) own();
+            (*this)[--count].~T();
+            // a gap that reaches the end is free room like any other
+            if (gap_at >= count) gap_at = count, gap_len = 0;
+            retop();
+        }
+
+        // replaces the remove items at index at with items. the gap moves to
+        // at first, so a splice only moves the items between it and the last
+        // one, then takes the removed slots and gives the new items theirs.
+        // when it runs out it grows by a sixteenth of the items, the one time
+        // the items after it all move. only plain items can be spliced
+        void splice(std::size_t at, std::size_t remove, std::span<const T> items) {
+            static_assert(std::is_trivially_copyable_v<T>, "only plain items can be spliced");
+            if (borrowed) own();
+            move_gap(at);
+            gap_len += remove;
+            count -= remove;
+            if (gap_len < items.size()) grow_gap(items.size() - gap_len + (count >> 4));
+            for (std::size_t i = 0; i < items.size(); i++) slot(at + i) = items[i];
+            gap_at += items.size();
+            gap_len -= items.size();
+            count += items.size();
+            if (gap_at == count && gap_len) {
+                gap_len = 0;
+                retop();
+            }
+        }
+
+        // drops every item and keeps enough blocks for the larger of this and
+        // the previous fill, so a one-off spike doesn't pin its memory
+        void reset() noexcept {
+            destroy_items();
+            if (borrowed) {
+                release_from(0);
+                borrowed = false;
+                count = gap_at = gap_len = 0;
+                top = top_end = nullptr;
+                return;
+            }
+            std::size_t high = used();
+            count = gap_at = gap_len = 0;
+            top = top_end = nullptr;
+            trim(high > last_high ? high : last_high);
+            last_high = high;
         }
 
-        short block_count() const noexcept { return count; }
+        // gives back the blocks not needed to hold keep items, never ones in
+        // use. the first block stays, a pool that is refilled now and then
+        // shouldn't go back to the system every time it comes up empty
+        void trim(std::size_t keep) noexcept {
+            if (keep < used()) keep = used();
+            release_from(keep ? block_of(keep - 1) + 1 : 1);
+        }
 
-        Pool(): blocks(new PoolBlock[1]) { blocks[0] = PoolBlock(DEFAULT_POOL_CAPACITY); }
+        Pool() = default;
+        Pool(const Pool&) = delete;
+        Pool(Pool&& other) noexcept
+            : count(other.count), gap_at(other.gap_at), gap_len(other.gap_len), top(other.top), top_end(other.top_end), last_high(other.last_high),
+              borrowed(other.borrowed), _stats(other._stats) {
+            for (unsigned int k = 0; k < POOL_MAX_BLOCKS; k++) {
+                blocks[k] = other.blocks[k];
+                other.blocks[k] = nullptr;
+            }
+            other.count = other.gap_at = other.gap_len = 0;
+            other.top = other.top_end = nullptr;
+            other.borrowed = false;
+        }
 
         ~Pool() {
-            for (int i = 0; i < count; i++) delete[] blocks[i].buf;
-            delete[] blocks;
+            destroy_items();
+            release_from(0);
         }
 
         template <typename... args> T* emplace(args&&... params) {
@@ -131,4 +552,9 @@ template <typename T> class Pool {
         T* insert(const T& item) {
             return new (_top()) T(item);
         }
-};
\ No newline at end of file
+};
+
+static_assert(std::ranges::random_access_range<Pool<int>> && std::ranges::sized_range<Pool<int>>);
+static_assert(std::ranges::random_access_range<const Pool<int>>);
+static_assert(std::ranges::random_access_range<decltype(std::declval<RawPool&>().blocks_view())>);
+static_assert(std::ranges::input_range<decltype(std::declval<RawPool&>().bytes())>);
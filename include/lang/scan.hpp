@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// bulk byte scanning for the lexer
+// classifies 64 bytes at a time into bitmasks and finds the first byte that
+// leaves a class with a bit scan, instead of testing one char per iteration.
+// the lexer keeps the masks of the block it is in, so every token in it is
+// found and told apart with bit tests, the block is classified once.
+// the kernel set is picked once at startup from what the cpu supports
+
+namespace scan {
+    enum class Level : char { SCALAR, SSE2, AVX2 };
+
+    // character classes of the scalar table. classify() fills a mask for
+    // each but NEWLINE, line_starts() finds those on its own
+    enum Class : unsigned char {
+        SPACE   = 1,  // ' ' \t \n \v \f \r
+        IDENT   = 2,  // A-Z a-z 0-9 _
+        DIGIT   = 4,  // 0-9
+        QUOTE   = 8,  // ' "
+        NEWLINE = 16, // \n
+        PUNCT   = 32, // anything else printable that the lexer may match
+    };
+
+    struct ClassTable {
+        unsigned char t[256] = {};
+        constexpr unsigned char operator[](unsigned char c) const { return t[c]; }
+    };
+
+    constexpr ClassTable make_table() {
+        ClassTable ct;
+        for (int c = 0; c < 256; c++) {
+            unsigned char cls = 0;
+            if (c == ' ' || (c >= '\t' && c <= '\r')) cls |= SPACE;
+            if (c == '\n') cls |= NEWLINE;
+            if (c >= '0' && c <= '9') cls |= DIGIT | IDENT;
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') cls |= IDENT;
+            if (c == '"' || c == '\'') cls |= QUOTE;
+            if (c > ' ' && c < 0x7f && !(cls & (IDENT | QUOTE))) cls |= PUNCT;
+            ct.t[c] = cls;
+        }
+        return ct;
+    }
+
+    inline constexpr ClassTable table = make_table();
+    inline bool is(char c, unsigned char cls) noexcept { return table[(unsigned char)c] & cls; }
+
+    // the classes of a 64 byte block, bit i for byte i
+    struct Masks {
+        std::uint64_t space, ident, digit, quote, punct;
+    };
+
+    struct Kernels {
+        // masks of the aligned 64 byte block at block
+        void (*classify)(const char* block, Masks& out);
+        // first byte that is not whitespace
+        const char* (*skip_space)(const char*);
+        // first byte equal to c or '\0'
+        const char* (*find_byte)(const char*, char c);
+        // offsets (from p) of the byte after every '\n' in [p, end), written
+        // to out when it isn't null. returns how many there are
+        std::size_t (*line_starts)(const char* p, const char* end, std::uint32_t* out);
+    };
+
+    // all kernels stop at '\0' (line_starts at end, which has to be one) and
+    // may read up to the end of the aligned 64 byte block holding it, but never past it
+    extern Kernels kernels;
+
+    Level detect() noexcept;
+    Level level() noexcept;
+    // forces a kernel set, clamped to what the cpu supports
+    void select(Level level) noexcept;
+
+    inline void classify(const char* block, Masks& out) { kernels.classify(block, out); }
+    inline const char* skip_space(const char* p) { return kernels.skip_space(p); }
+    inline const char* find_byte(const char* p, char c) { return kernels.find_byte(p, c); }
+    inline std::size_t line_starts(const char* p, const char* end, std::uint32_t* out) { return kernels.line_starts(p, end, out); }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+// zero bytes guaranteed after every source, enough for a full simd block
+#define SOURCE_PADDING 64
+
+// a read-only source followed by at least SOURCE_PADDING zero bytes, so the
+// lexer can read past the end without bounds checks. regular files are
+// memory mapped in place, anything else (pipes, stdin as "-") is read into
+// a padded heap buffer
+class SourceBuffer {
+    const char* _data = nullptr;
+    std::size_t _size = 0;
+    std::size_t _mapped = 0; // length of the mapping, 0 if heap allocated
+    bool _loaded = false;
+
+    public:
+        SourceBuffer() = default;
+        SourceBuffer(const SourceBuffer&) = delete;
+        SourceBuffer& operator=(const SourceBuffer&) = delete;
+        SourceBuffer(SourceBuffer&& other) noexcept { *this = std::move(other); }
+        SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+        ~SourceBuffer();
+
+        // not loaded if the file can't be opened or read
+        static SourceBuffer load(const char* path);
+        // copies text into a padded buffer
+        static SourceBuffer copy(const char* text, std::size_t size);
+
+        explicit operator bool() const noexcept { return _loaded; }
+        const char* data() const noexcept { return _data; }
+        std::size_t size() const noexcept { return _size; }
+        bool mapped() const noexcept { return _mapped != 0; }
+};
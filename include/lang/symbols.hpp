@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <lang/pool.hpp>
+#include <lang/view.hpp>
+
+// hashes up to 8 bytes per step, identifiers are mostly shorter than that
+inline std::uint32_t hash_text(const char* text, std::size_t len) noexcept {
+    std::uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+    while (len >= 8) {
+        std::uint64_t w; std::memcpy(&w, text, 8);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 31;
+        text += 8; len -= 8;
+    }
+    std::uint64_t w = 0; std::memcpy(&w, text, len);
+    h = (h ^ w) * 0x94d049bb133111ebull;
+    return (std::uint32_t)(h ^ (h >> 32));
+}
+
+// interns identifier text once, handing out dense ids in first-seen order
+// names live in an arena, lookup is open addressing with linear probing
+class SymbolTable {
+    struct Slot { std::uint32_t hash = 0, id = 0; }; // id is +1, 0 marks empty
+
+    RawPool store;
+    TextView* names = nullptr;
+    std::uint32_t* hashes = nullptr;
+    std::uint32_t count = 0, name_capacity = 0;
+
+    Slot* slots = nullptr;
+    std::uint32_t mask = 0; // slot count - 1
+
+    // the arrays come from the block cache too, like the pools' blocks
+    template <typename T> static T* take(std::size_t n) {
+        bool reused;
+        return static_cast<T*>(block_cache::acquire(n * sizeof(T), reused));
+    }
+    template <typename T> static void give(T* array, std::size_t n) noexcept { block_cache::release(array, n * sizeof(T)); }
+
+    void grow_names() {
+        std::uint32_t capacity = name_capacity ? name_capacity << 1 : 64;
+        TextView* new_names = take<TextView>(capacity);
+        std::uint32_t* new_hashes = take<std::uint32_t>(capacity);
+        if (count) {
+            std::memcpy((void*)new_names, names, count * sizeof(TextView));
+            std::memcpy(new_hashes, hashes, count * sizeof(std::uint32_t));
+        }
+        give(names, name_capacity); give(hashes, name_capacity);
+        names = new_names; hashes = new_hashes;
+        name_capacity = capacity;
+    }
+
+    // kept at most half full
+    void rehash() {
+        std::uint32_t slot_count = mask ? (mask + 1) << 1 : 128;
+        give(slots, mask ? mask + 1 : 0);
+        slots = take<Slot>(slot_count);
+        std::memset((void*)slots, 0, slot_count * sizeof(Slot));
+        mask = slot_count - 1;
+        for (std::uint32_t id = 0; id < count; id++) {
+            std::uint32_t i = hashes[id] & mask;
+            while (slots[i].id) i = (i + 1) & mask;
+            slots[i] = { hashes[id], id + 1 };
+        }
+    }
+
+    public:
+        static constexpr std::uint32_t NONE = ~std::uint32_t(0);
+
+        SymbolTable() { rehash(); }
+        SymbolTable(const SymbolTable&) = delete;
+        SymbolTable(SymbolTable&& other) noexcept
+            : store(std::move(other.store)), names(other.names), hashes(other.hashes),
+              count(other.count), name_capacity(other.name_capacity), slots(other.slots), mask(other.mask) {
+            other.names = nullptr; other.hashes = nullptr; other.slots = nullptr;
+            other.count = other.name_capacity = other.mask = 0;
+        }
+
+        ~SymbolTable() {
+            give(names, name_capacity);
+            give(hashes, name_capacity);
+            give(slots, mask ? mask + 1 : 0);
+        }
+
+        // forgets every name, keeping the arrays and the name store's blocks
+        void reset() noexcept {
+            store.reset();
+            count = 0;
+            std::memset((void*)slots, 0, (mask + 1) * sizeof(Slot));
+        }
+
+        std::uint32_t size() const noexcept { return count; }
+        // where the names are kept
+        const RawPool& storage() const noexcept { return store; }
+        TextView name(std::uint32_t id) const noexcept { return names[id]; }
+
+        // NONE if never interned
+        std::uint32_t find(const char* text, std::size_t len) const noexcept {
+            std::uint32_t hash = hash_text(text, len);
+            for (std::uint32_t i = hash & mask; slots[i].id; i = (i + 1) & mask) {
+                const Slot& slot = slots[i];
+                if (slot.hash == hash && names[slot.id - 1] == TextView(text, text + len)) return slot.id - 1;
+            }
+            return NONE;
+        }
+
+        std::uint32_t intern(const char* text, std::size_t len) {
+            std::uint32_t hash = hash_text(text, len);
+            std::uint32_t i = hash & mask;
+            for (; slots[i].id; i = (i + 1) & mask) {
+                const Slot& slot = slots[i];
+                if (slot.hash == hash && names[slot.id - 1] == TextView(text, text + len)) return slot.id - 1;
+            }
+
+            if (count == name_capacity) grow_names();
+            char* copy = store.allocate((unsigned int)len);
+            std::memcpy(copy, text, len);
+            names[count] = TextView(copy, copy + len);
+            hashes[count] = hash;
+            slots[i] = { hash, ++count };
+
+            if (count * 2 > mask + 1) rehash();
+            return count - 1;
+        }
+
+        std::uint32_t intern(const TextView& text) { return intern(text.data(), text.size()); }
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// work-stealing pool of threads running items through one handler. every
+// worker has a deque: it takes the newest item of its own (what it just
+// spawned, still warm) and, when that's empty, steals the oldest item of
+// another's, the one likely to spawn the most. items spawned by the handler
+// go to the spawning worker's deque, so no queue is shared by every thread
+class TaskPool {
+    struct alignas(64) Queue {
+        std::mutex lock;
+        std::deque<std::uint32_t> items;
+    };
+
+    std::unique_ptr<Queue[]> queues;
+    unsigned int workers;
+    std::atomic<std::size_t> pending = 0;  // spawned and not done yet
+    std::atomic<std::uint32_t> signal = 0; // bumped on every spawn and at the end, idle workers wait on it
+    std::function<void(std::uint32_t)> handler;
+
+    bool take(unsigned int self, std::uint32_t& item);
+    void work(unsigned int self);
+
+    public:
+        // jobs threads, the one calling run() is one of them
+        explicit TaskPool(int jobs);
+        TaskPool(const TaskPool&) = delete;
+
+        unsigned int size() const noexcept { return workers; }
+
+        // from the handler onto the calling worker's deque, from elsewhere
+        // onto the first one
+        void spawn(std::uint32_t item);
+
+        // runs handler over every spawned item, and the ones they spawn,
+        // until there are none left
+        void run(std::function<void(std::uint32_t)> handler);
+};
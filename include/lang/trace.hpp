@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+// chrome / perfetto trace-event recording, for -trace=out.json
+// every thread records into its own buffer, nothing is shared or locked
+// while recording. spans and counters cost a relaxed load when tracing isn't
+// running, and build with DOYT_TRACE=0 drops them entirely
+
+#ifndef DOYT_TRACE
+#define DOYT_TRACE 1
+#endif
+
+#if DOYT_TRACE
+
+#include <atomic>
+
+namespace trace {
+    extern std::atomic<bool> recording;
+    inline bool enabled() noexcept { return recording.load(std::memory_order_relaxed); }
+
+    // time zero of the trace, recording goes on until write()
+    void start();
+    // everything recorded so far, false if path can't be written
+    bool write(const char* path);
+
+    // names are expected to outlive the trace (string literals, argv)
+    void begin(const char* name, const char* detail, std::int64_t arg);
+    void end();
+    // one series of the counter track name, series of a track stack up
+    void counter(const char* name, const char* series, std::int64_t value);
+    // names the calling thread's track
+    void thread_name(const char* name);
+
+    struct Span {
+        bool live;
+        Span(const char* name, const char* detail = nullptr, std::int64_t arg = -1): live(enabled()) {
+            if (live) begin(name, detail, arg);
+        }
+        Span(const char* name, std::int64_t arg): Span(name, nullptr, arg) {}
+        Span(const Span&) = delete;
+        ~Span() { if (live) end(); }
+    };
+}
+
+#define TRACE_CAT2(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT2(a, b)
+// a span from here to the end of the scope, optionally with a detail string and/or an integer arg
+#define TRACE_SPAN(...) trace::Span TRACE_CAT(trace_span_, __LINE__)(__VA_ARGS__)
+#define TRACE_COUNTER(name, series, value) do { if (trace::enabled()) trace::counter(name, series, value); } while (0)
+#define TRACE_THREAD(name) do { if (trace::enabled()) trace::thread_name(name); } while (0)
+
+#else
+
+#define TRACE_SPAN(...) ((void)0)
+#define TRACE_COUNTER(name, series, value) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+
+#endif
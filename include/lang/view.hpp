@@ -1,4 +1,6 @@
+#pragma once
 #include <cstring>
+#include <ostream>
 #include <string>
 
 class TextView {
@@ -19,4 +21,8 @@ class TextView {
         bool operator==(const std::string& other) const {
             return _len == other.size() && std::memcmp(_data, other.data(), _len) == 0;
         }
-};
\ No newline at end of file
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const TextView& view) {
+    return stream.write(view.data(), view.size());
+}
\ No newline at end of file
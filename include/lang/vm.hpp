@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include <lang/bytecode.hpp>
+
+// registers of every live call, in values. a call's registers start right
+// after its callee's register in the caller, the arguments are already there
+#define VM_STACK_SIZE (1 << 18)
+// calls nested at most
+#define VM_MAX_DEPTH (1 << 16)
+
+#ifndef DOYT_COMPUTED_GOTO
+#define DOYT_COMPUTED_GOTO 1
+#endif
+
+// runs a Bytecode's function 0. values are nil, bools, 64 bit ints and
+// doubles (ints where both operands are, doubles otherwise), strings and
+// functions. nil, false and zero are falsy. the dispatch loop jumps from
+// handler to handler through a label table with GCC and Clang (an indirect
+// jump per handler, each predicted on its own), and is a switch elsewhere.
+// runtime errors are reported where the instruction came from and stop the
+// run, nothing throws
+class VM {
+    struct Frame {
+        const Function* fn;
+        const Instr* pc; // to return to
+        Value* base;
+    };
+
+    const Bytecode& code;
+    const LexOutput& lex;
+    Diagnostics& diags;
+    std::ostream& out;
+
+    // the stack is raw memory, its pages are only touched as deep as calls
+    // go. a call clears its registers before they're read
+    struct Release { void operator()(Value* values) const { ::operator delete(values); } };
+    std::unique_ptr<Value, Release> stack;
+    std::unique_ptr<Frame[]> frames;
+    std::vector<Value> globals;
+
+    bool fail(const Function* fn, const Instr* at, DiagCode diag, std::uint32_t arg0 = 0, std::uint32_t arg1 = 0);
+    // result can be where the callee was, it's written last. false and error set on an error
+    bool native(std::uint32_t index, const Value* args, std::uint32_t count, Value& result, DiagCode& error, std::uint32_t& arg);
+
+    public:
+        // lex is what code was compiled from, runtime errors are placed with it
+        VM(const Bytecode& code, const LexOutput& lex, Diagnostics& diags, std::ostream& out);
+        VM(const VM&) = delete;
+
+        // false if it stopped on an error. globals keep their values after
+        bool run();
+
+        // nil if nothing is called that
+        Value global(std::string_view name) const;
+        std::ostream& print(std::ostream& stream, const Value& value) const;
+};
@@ -0,0 +1,303 @@
+#include <lang/cache.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <vector>
+#include <lang/trace.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CACHE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef DOYT_VERSION
+#define DOYT_VERSION "dev"
+#endif
+
+// xxh64's structure: four lanes over 32 byte stripes, so the multiplies of
+// one stripe don't wait on each other, then the tail and an avalanche
+namespace {
+    constexpr std::uint64_t P1 = 0x9e3779b185ebca87ull, P2 = 0xc2b2ae3d27d4eb4full;
+    constexpr std::uint64_t P3 = 0x165667b19e3779f9ull, P4 = 0x85ebca77c2b2ae63ull;
+
+    inline std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    inline std::uint64_t load64(const char* p) { std::uint64_t w; std::memcpy(&w, p, 8); return w; }
+    inline std::uint64_t lane(std::uint64_t acc, std::uint64_t w) { return rotl(acc + w * P2, 31) * P1; }
+}
+
+std::uint64_t hash_bytes(const void* data, std::size_t size, std::uint64_t seed) noexcept {
+    const char* p = (const char*)data;
+    const char* end = p + size;
+    std::uint64_t h = seed + P3;
+
+    if (size >= 32) {
+        std::uint64_t v[4] = { seed + P1 + P2, seed + P2, seed, seed - P1 };
+        for (; end - p >= 32; p += 32) {
+            for (int i = 0; i < 4; i++) v[i] = lane(v[i], load64(p + 8 * i));
+        }
+        h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+        for (int i = 0; i < 4; i++) h = (h ^ lane(0, v[i])) * P1 + P4;
+    }
+
+    h += size;
+    for (; end - p >= 8; p += 8) h = rotl(h ^ lane(0, load64(p)), 27) * P1 + P4;
+    for (; p < end; p++) h = rotl(h ^ ((unsigned char)*p * P3), 11) * P1;
+
+    h ^= h >> 33; h *= P2;
+    h ^= h >> 29; h *= P3;
+    return h ^ (h >> 32);
+}
+
+void compile(Unit& unit, const SourceBuffer& source, std::size_t max_depth) {
+    tokenize(unit.lex, &source, 1);
+    parse(unit.ast, unit.lex, unit.lex.diagnostics(), max_depth);
+}
+
+// a unit file: the header, then every section 64 byte aligned, in this order
+namespace {
+    enum Section : unsigned { TOKENS, OFFSETS, INTS, FLOATS, STRINGS, SYMBOL_TEXT, SYMBOLS, DIAGNOSTICS, NODES, LISTS, SECTION_COUNT };
+
+    // a piece of the source (STRINGS) or of SYMBOL_TEXT (SYMBOLS)
+    struct Piece { std::uint32_t offset, length; };
+
+    constexpr std::size_t item_size[SECTION_COUNT] = {
+        sizeof(Token), sizeof(std::uint32_t), sizeof(std::int64_t), sizeof(double), sizeof(Piece),
+        1, sizeof(Piece), sizeof(Diagnostic), sizeof(Node), sizeof(std::uint32_t),
+    };
+
+    struct SectionRef { std::uint64_t offset, count; };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t format, header_size;
+        std::uint64_t key, source_size;
+        std::uint64_t file_size, checksum; // checksum of everything past the header
+        std::uint32_t root, unused;        // the PROGRAM node
+        SectionRef sections[SECTION_COUNT];
+    };
+
+    constexpr char MAGIC[8] = { 'D', 'O', 'Y', 'T', 'U', 'N', 'I', 'T' };
+    constexpr std::size_t SECTION_ALIGN = 64;
+
+    // a key changes with the version and with the layout of anything stored as it is
+    std::uint64_t version_seed() {
+        static const std::uint64_t seed = [] {
+            const char version[] = DOYT_VERSION;
+            std::uint64_t layout[] = { DOYT_CACHE_FORMAT, sizeof(Token), sizeof(Node), sizeof(Diagnostic), (std::uint64_t)TokenCode::_COUNT };
+            return hash_bytes(layout, sizeof(layout), hash_bytes(version, sizeof(version) - 1));
+        }();
+        return seed;
+    }
+
+    // a whole file, readable and privately writable, so pools can borrow from it
+    std::shared_ptr<char> map_file(const std::string& path, std::size_t& size) {
+#ifdef CACHE_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || !st.st_size) { close(fd); return nullptr; }
+        size = (std::size_t)st.st_size;
+        void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (region == MAP_FAILED) return nullptr;
+        return std::shared_ptr<char>((char*)region, [size](char* p) { munmap(p, size); });
+#else
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) return nullptr;
+        long length = std::fseek(f, 0, SEEK_END) == 0 ? std::ftell(f) : -1;
+        if (length <= 0) { std::fclose(f); return nullptr; }
+        std::rewind(f);
+        size = (std::size_t)length;
+        auto align = std::align_val_t(SECTION_ALIGN);
+        std::shared_ptr<char> data((char*)::operator new(size, align), [align](char* p) { ::operator delete(p, align); });
+        bool read = std::fread(data.get(), 1, size, f) == size;
+        std::fclose(f);
+        return read ? data : nullptr;
+#endif
+    }
+
+    // appends a pool's items to the file image as one section, a run at a
+    // time so an edited pool's gap is left out
+    template <typename T> void put(std::vector<char>& image, SectionRef& ref, const Pool<T>& pool) {
+        ref = { image.size(), pool.size() };
+        for (std::size_t i = 0; i < pool.size();) {
+            std::span<const T> run = pool.run(i, pool.size());
+            const char* bytes = (const char*)run.data();
+            image.insert(image.end(), bytes, bytes + run.size_bytes());
+            i += run.size();
+        }
+    }
+
+    template <typename T> void put(std::vector<char>& image, SectionRef& ref, const std::vector<T>& items) {
+        ref = { image.size(), items.size() };
+        const char* bytes = (const char*)items.data();
+        image.insert(image.end(), bytes, bytes + items.size() * sizeof(T));
+    }
+
+    void align(std::vector<char>& image) { image.resize((image.size() + SECTION_ALIGN - 1) & ~(SECTION_ALIGN - 1)); }
+}
+
+UnitCache::UnitCache(const char* dir): dir(dir) {
+    std::error_code ignored;
+    std::filesystem::create_directories(dir, ignored);
+}
+
+std::string UnitCache::path_of(std::uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.dyu", (unsigned long long)key);
+    return dir + name;
+}
+
+std::uint64_t UnitCache::key_of(const SourceBuffer& source) noexcept {
+    return hash_bytes(source.data(), source.size(), version_seed());
+}
+
+bool UnitCache::store(const SourceBuffer& source, const Unit& unit) const {
+    TRACE_SPAN("cache store");
+    const LexOutput& lex = unit.lex;
+    if (lex.files().size() != 1 || unit.ast.root() == NO_NODE) return false;
+
+    // strings are kept as where they are in the source, offsets from its
+    // start, an edited unit counts some from the end
+    std::vector<Piece> strings(lex.string_table.size());
+    for (std::size_t i = 0; i < strings.size(); i++) {
+        TextView text = lex.string((std::uint32_t)i);
+        if (text.data() < source.data() || text.data() + text.size() > source.data() + source.size()) return false;
+        strings[i] = { (std::uint32_t)(text.data() - source.data()), (std::uint32_t)text.size() };
+    }
+    std::vector<std::uint32_t> offsets(lex.count());
+    for (std::size_t i = 0; i < offsets.size(); i++) offsets[i] = lex.offset(i);
+    std::vector<char> symbol_text;
+    std::vector<Piece> symbols(lex.symbols().size());
+    for (std::uint32_t id = 0; id < symbols.size(); id++) {
+        TextView name = lex.symbols().name(id);
+        symbols[id] = { (std::uint32_t)symbol_text.size(), (std::uint32_t)name.size() };
+        symbol_text.insert(symbol_text.end(), name.data(), name.data() + name.size());
+    }
+    std::vector<Diagnostic> diagnostics(lex.diagnostics().begin(), lex.diagnostics().end());
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.format = DOYT_CACHE_FORMAT;
+    header.header_size = sizeof(Header);
+    header.key = key_of(source);
+    header.source_size = source.size();
+    header.root = unit.ast.root();
+
+    std::vector<char> image(sizeof(Header));
+    auto section = [&](Section s, auto& items) { align(image); put(image, header.sections[s], items); };
+    section(TOKENS, lex.token_pool);
+    section(OFFSETS, offsets);
+    section(INTS, lex.int_table);
+    section(FLOATS, lex.float_table);
+    section(STRINGS, strings);
+    section(SYMBOL_TEXT, symbol_text);
+    section(SYMBOLS, symbols);
+    section(DIAGNOSTICS, diagnostics);
+    section(NODES, unit.ast.node_pool);
+    section(LISTS, unit.ast.list_pool);
+    align(image);
+
+    header.file_size = image.size();
+    header.checksum = hash_bytes(image.data() + sizeof(Header), image.size() - sizeof(Header));
+    std::memcpy(image.data(), &header, sizeof(Header));
+
+    // unique per process, two compilers filling the same cache don't collide
+    std::string path = path_of(header.key);
+    std::string temp = path + ".tmp" + std::to_string(
+#ifdef CACHE_MMAP
+        (long)getpid()
+#else
+        (long)(std::uintptr_t)&image
+#endif
+    );
+    std::FILE* f = std::fopen(temp.c_str(), "wb");
+    if (!f) return false;
+    bool written = std::fwrite(image.data(), 1, image.size(), f) == image.size();
+    written &= std::fclose(f) == 0;
+    std::error_code error;
+    if (written) std::filesystem::rename(temp, path, error);
+    if (!written || error) {
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+    return true;
+}
+
+bool UnitCache::load(const SourceBuffer& source, Unit& unit) const {
+    TRACE_SPAN("cache load");
+    unit.lex.reset();
+    unit.ast.reset();
+
+    std::uint64_t key = key_of(source);
+    std::size_t size = 0;
+    std::shared_ptr<char> file = map_file(path_of(key), size);
+    if (!file || size < sizeof(Header)) return false;
+
+    Header header;
+    std::memcpy(&header, file.get(), sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.format != DOYT_CACHE_FORMAT
+        || header.header_size != sizeof(Header) || header.key != key || header.source_size != source.size()
+        || header.file_size != size) return false;
+    for (unsigned s = 0; s < SECTION_COUNT; s++) {
+        const SectionRef& ref = header.sections[s];
+        if (ref.offset % SECTION_ALIGN || ref.offset < sizeof(Header) || ref.offset > size) return false;
+        if (ref.count > (size - ref.offset) / item_size[s]) return false;
+    }
+    const SectionRef* sections = header.sections;
+    if (!sections[TOKENS].count || sections[OFFSETS].count != sections[TOKENS].count) return false;
+    if (header.root + 1 != sections[NODES].count) return false;
+    {
+        TRACE_SPAN("cache checksum");
+        if (hash_bytes(file.get() + sizeof(Header), size - sizeof(Header)) != header.checksum) return false;
+    }
+
+    auto items = [&]<typename T>(Section s, T*) { return (T*)(file.get() + sections[s].offset); };
+    LexOutput& lex = unit.lex;
+
+    // names and views are rebuilt, everything else is borrowed where it lies
+    const char* symbol_text = items(SYMBOL_TEXT, (char*)nullptr);
+    const Piece* symbols = items(SYMBOLS, (Piece*)nullptr);
+    for (std::uint32_t id = 0; id < sections[SYMBOLS].count; id++) {
+        Piece name = symbols[id];
+        if (name.offset > sections[SYMBOL_TEXT].count || name.length > sections[SYMBOL_TEXT].count - name.offset
+            || lex.symbol_table.intern(symbol_text + name.offset, name.length) != id) {
+            lex.reset();
+            return false;
+        }
+    }
+    const Piece* strings = items(STRINGS, (Piece*)nullptr);
+    for (std::size_t i = 0; i < sections[STRINGS].count; i++) {
+        Piece text = strings[i];
+        if (text.offset > source.size() || text.length > source.size() - text.offset) {
+            lex.reset();
+            return false;
+        }
+        lex.string_table.insert({ 0, text.offset, text.length });
+    }
+    const Diagnostic* diagnostics = items(DIAGNOSTICS, (Diagnostic*)nullptr);
+    for (std::size_t i = 0; i < sections[DIAGNOSTICS].count; i++) {
+        const Diagnostic& diag = diagnostics[i];
+        lex.diagnostic_sink.report(diag.code, diag.file, diag.offset, diag.args[0], diag.args[1]);
+    }
+
+    lex.token_pool.borrow(items(TOKENS, (Token*)nullptr), sections[TOKENS].count);
+    lex.offset_pool.borrow(items(OFFSETS, (std::uint32_t*)nullptr), sections[OFFSETS].count);
+    lex.int_table.borrow(items(INTS, (std::int64_t*)nullptr), sections[INTS].count);
+    lex.float_table.borrow(items(FLOATS, (double*)nullptr), sections[FLOATS].count);
+    lex.file_ranges.push_back({ 0, sections[TOKENS].count - 1 });
+    lex.file_texts.push_back({ source.data(), (std::uint32_t)source.size() });
+    lex.backing = file;
+
+    unit.ast.node_pool.borrow(items(NODES, (Node*)nullptr), sections[NODES].count);
+    unit.ast.list_pool.borrow(items(LISTS, (std::uint32_t*)nullptr), sections[LISTS].count);
+    unit.ast.root_node = header.root;
+    unit.ast.backing = file;
+    return true;
+}
@@ -0,0 +1,643 @@
+#include <lang/bytecode.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <lang/trace.hpp>
+
+const char* opcode_name(Opcode op) noexcept {
+    switch (op) {
+#define OPCODE(op, name) case Opcode::op: return name;
+        DOYT_OPCODES(OPCODE)
+#undef OPCODE
+        default: return "?";
+    }
+}
+
+std::ostream& Bytecode::print(std::ostream& stream) const {
+    for (std::size_t f = 0; f < functions.size(); f++) {
+        const Function& fn = functions[f];
+        stream << "function " << f << " " << fn.name << ": " << (int)fn.params << " params, "
+            << (int)fn.registers << " registers, " << fn.constants.size() << " constants\n";
+        for (std::size_t pc = 0; pc < fn.code.size(); pc++) {
+            Instr i = fn.code[pc];
+            stream << "  " << pc << "\t" << opcode_name(i.op()) << "\t";
+            switch (i.op()) {
+                case Opcode::LOADK: case Opcode::GETGLOBAL: case Opcode::SETGLOBAL:
+                    stream << (int)i.a() << " " << i.bx(); break;
+                case Opcode::LOADI: case Opcode::JMPF: case Opcode::JMPT: case Opcode::FORPREP: case Opcode::FORLOOP:
+                    stream << (int)i.a() << " " << i.sbx(); break;
+                case Opcode::JMP:
+                    stream << i.sbx() << " (to " << (std::int64_t)pc + 1 + i.sbx() << ")"; break;
+                case Opcode::ADDI:
+                    stream << (int)i.a() << " " << (int)i.b() << " " << (int)(std::int8_t)i.c(); break;
+                default:
+                    stream << (int)i.a() << " " << (int)i.b() << " " << (int)i.c();
+            }
+            stream << "\n";
+        }
+    }
+    return stream;
+}
+
+namespace {
+    // jumps out of a loop, patched once its end is known
+    struct Loop {
+        std::vector<std::size_t> breaks, continues;
+    };
+
+    // a function being compiled. names are locals (registers) inside a
+    // func, declared up front from the params and every name assigned in
+    // the body, and globals at the top level
+    struct FunctionState {
+        Function fn;
+        bool top;
+        std::vector<std::pair<std::uint32_t, std::uint8_t>> locals; // symbol, register
+        std::unordered_map<std::int64_t, std::uint16_t> constant_slots[(int)ValueType::NATIVE + 1]; // by type, then bits
+        std::uint32_t next = 0; // first free register
+        std::vector<Loop> loops;
+
+        explicit FunctionState(bool top): top(top) {}
+    };
+
+    class Compiler {
+        Bytecode& out;
+        const Ast& ast;
+        const LexOutput& lex;
+        Diagnostics& diags;
+        bool failed = false;
+
+        std::unordered_map<std::uint32_t, std::uint16_t> global_slots; // by symbol
+        std::unordered_set<std::uint32_t> hoisted; // top level funcs, defined before the rest runs
+        std::unordered_map<std::string_view, std::uint32_t> string_slots; // by text, viewing the lexer's strings
+        FunctionState* fs = nullptr;
+        std::uint32_t token = 0; // what the next instruction comes from
+        std::size_t depth = 0; // of expr calls, bounded like the parser's nesting
+        // the lexer leaves these names, they're constants unless a local shadows them
+        std::uint32_t true_symbol, false_symbol, nil_symbol;
+
+        void error(DiagCode code, std::uint32_t at, std::uint32_t arg0 = 0, std::uint32_t arg1 = 0) {
+            diags.report(code, lex.file_of(at), lex.offset(at), arg0, arg1);
+            failed = true;
+        }
+
+        std::uint32_t symbol_of(std::uint32_t name) const { return lex.tokens()[ast[name].token].value<std::uint32_t>(); }
+
+        std::size_t emit(Instr i) {
+            fs->fn.code.push_back(i);
+            fs->fn.tokens.push_back(token);
+            return fs->fn.code.size() - 1;
+        }
+        std::size_t here() const { return fs->fn.code.size(); }
+
+        // makes the jump at from land at to
+        void patch(std::size_t from, std::size_t to) {
+            std::int64_t offset = (std::int64_t)to - (std::int64_t)(from + 1);
+            if (offset < INT16_MIN || offset > INT16_MAX) {
+                error(DiagCode::TOO_FAR_JUMP, fs->fn.tokens[from], INT16_MAX);
+                return;
+            }
+            fs->fn.code[from].set_sbx((std::int16_t)offset);
+        }
+        void patch_all(const std::vector<std::size_t>& jumps, std::size_t to) {
+            for (std::size_t from : jumps) patch(from, to);
+        }
+
+        std::uint8_t alloc() {
+            if (fs->next >= VM_MAX_REGISTERS) {
+                if (fs->next++ == VM_MAX_REGISTERS) error(DiagCode::TOO_MANY_REGISTERS, token, VM_MAX_REGISTERS);
+                return VM_MAX_REGISTERS - 1;
+            }
+            std::uint8_t reg = (std::uint8_t)fs->next++;
+            fs->fn.registers = std::max<std::uint8_t>(fs->fn.registers, fs->next);
+            return reg;
+        }
+        std::uint8_t target(int dest) { return dest >= 0 ? (std::uint8_t)dest : alloc(); }
+        // a value already in reg, copied to dest if there's one
+        std::uint8_t move(int reg, int dest) {
+            if (dest < 0 || dest == reg) return (std::uint8_t)reg;
+            emit(Instr::abc(Opcode::MOVE, (std::uint8_t)dest, (std::uint8_t)reg));
+            return (std::uint8_t)dest;
+        }
+
+        std::uint16_t constant(Value value) {
+            std::vector<Value>& constants = fs->fn.constants;
+            auto [slot, added] = fs->constant_slots[(int)value.type].try_emplace(value.i, (std::uint16_t)constants.size());
+            if (!added) return slot->second;
+            if (constants.size() > UINT16_MAX) {
+                fs->constant_slots[(int)value.type].erase(slot);
+                error(DiagCode::TOO_MANY_CONSTANTS, token, UINT16_MAX);
+                return 0;
+            }
+            constants.push_back(value);
+            return slot->second;
+        }
+
+        int local_of(std::uint32_t symbol) const {
+            for (auto local = fs->locals.rbegin(); local != fs->locals.rend(); ++local) {
+                if (local->first == symbol) return local->second;
+            }
+            return -1;
+        }
+        std::uint8_t declare(std::uint32_t symbol) {
+            int reg = local_of(symbol);
+            if (reg >= 0) return (std::uint8_t)reg;
+            std::uint8_t fresh = alloc();
+            fs->locals.push_back({ symbol, fresh });
+            return fresh;
+        }
+        std::uint16_t global_of(std::uint32_t symbol) {
+            auto [slot, added] = global_slots.try_emplace(symbol, (std::uint16_t)out.globals.size());
+            if (added) {
+                TextView name = lex.symbols().name(symbol);
+                out.globals.emplace_back(name.data(), name.size());
+            }
+            return slot->second;
+        }
+
+        // value into the place a name stands for
+        void store(std::uint32_t name, std::uint8_t value) {
+            std::uint32_t symbol = symbol_of(name);
+            int reg = fs->top ? -1 : local_of(symbol);
+            if (reg < 0) emit(Instr::abx(Opcode::SETGLOBAL, value, global_of(symbol)));
+            else if (reg != value) emit(Instr::abc(Opcode::MOVE, (std::uint8_t)reg, value));
+        }
+
+        // calls visit on the nodes of the tree at root, in no particular
+        // order, not going into funcs below it
+        template <typename F> void each_node(std::uint32_t root, F&& visit) {
+            std::vector<std::uint32_t> stack{ root };
+            while (!stack.empty()) {
+                std::uint32_t index = stack.back();
+                stack.pop_back();
+                if (index == NO_NODE) continue;
+                const Node& node = ast[index];
+                visit(index, node);
+                if (node.kind == NodeKind::FUNC && index != root) continue;
+                if (node.is_list()) {
+                    for (std::uint32_t child : ast.list(node)) stack.push_back(child);
+                    continue;
+                }
+                switch (node.kind) {
+                    case NodeKind::ERROR: case NodeKind::LITERAL: case NodeKind::NAME: case NodeKind::BREAK: case NodeKind::CONTINUE:
+                        break;
+                    case NodeKind::UNARY: case NodeKind::RET: case NodeKind::GET:
+                        stack.push_back(node.a);
+                        break;
+                    default:
+                        stack.push_back(node.a);
+                        stack.push_back(node.b);
+                }
+            }
+        }
+
+        std::uint8_t literal(const Node& node, int dest) {
+            Token tok = lex.tokens()[node.token];
+            std::uint8_t d = target(dest);
+            switch (tok.code()) {
+                case TokenCode::INT: {
+                    std::int64_t value = lex.integer(tok.value<std::uint32_t>());
+                    if (value >= INT16_MIN && value <= INT16_MAX) emit(Instr::asbx(Opcode::LOADI, d, (std::int16_t)value));
+                    else emit(Instr::abx(Opcode::LOADK, d, constant(Value::integer(value))));
+                    break;
+                }
+                case TokenCode::CHAR:
+                    emit(Instr::asbx(Opcode::LOADI, d, (std::int16_t)(unsigned char)tok.value<char>()));
+                    break;
+                case TokenCode::FLOAT:
+                    emit(Instr::abx(Opcode::LOADK, d, constant(Value::number(lex.number(tok.value<std::uint32_t>())))));
+                    break;
+                case TokenCode::STRING: {
+                    // the same text is the same string, so equality is an index compare
+                    TextView text = lex.string(tok.value<std::uint32_t>());
+                    auto [slot, added] = string_slots.try_emplace(std::string_view(text.data(), text.size()), (std::uint32_t)out.strings.size());
+                    if (added) out.strings.emplace_back(text.data(), text.size());
+                    emit(Instr::abx(Opcode::LOADK, d, constant(Value::of(ValueType::STRING, slot->second))));
+                    break;
+                }
+                case TokenCode::BOOL:
+                    emit(Instr::abc(Opcode::LOADBOOL, d, tok.value<bool>()));
+                    break;
+                default:
+                    emit(Instr::abc(Opcode::LOADNIL, d));
+            }
+            return d;
+        }
+
+        // the value of node in a register: dest if it's given, a local's own
+        // register or a fresh one otherwise
+        std::uint8_t expr(std::uint32_t index, int dest = -1) {
+            const Node& node = ast[index];
+            if (depth == PARSE_MAX_DEPTH) {
+                error(DiagCode::TOO_DEEP_EXPRESSION, node.token, PARSE_MAX_DEPTH);
+                return target(dest);
+            }
+            ++depth;
+            std::uint32_t outer = token;
+            token = node.token;
+            std::uint32_t mark = fs->next;
+            std::uint8_t result;
+
+            switch (node.kind) {
+                case NodeKind::LITERAL:
+                    result = literal(node, dest);
+                    break;
+
+                case NodeKind::NAME: {
+                    std::uint32_t symbol = symbol_of(index);
+                    int reg = fs->top ? -1 : local_of(symbol);
+                    if (reg >= 0) {
+                        result = move(reg, dest);
+                    } else if (symbol == true_symbol || symbol == false_symbol) {
+                        result = target(dest);
+                        emit(Instr::abc(Opcode::LOADBOOL, result, symbol == true_symbol));
+                    } else if (symbol == nil_symbol) {
+                        result = target(dest);
+                        emit(Instr::abc(Opcode::LOADNIL, result));
+                    } else {
+                        result = target(dest);
+                        emit(Instr::abx(Opcode::GETGLOBAL, result, global_of(symbol)));
+                    }
+                    break;
+                }
+
+                case NodeKind::UNARY: {
+                    std::uint8_t operand = expr(node.a);
+                    fs->next = mark;
+                    result = target(dest);
+                    emit(Instr::abc(node.op == Op::NOT ? Opcode::NOT : Opcode::NEG, result, operand));
+                    break;
+                }
+
+                case NodeKind::BINARY:
+                    result = binary(node, dest, mark);
+                    break;
+
+                case NodeKind::ASSIGN: {
+                    if (ast[node.a].kind != NodeKind::NAME) {
+                        error(DiagCode::UNSUPPORTED, ast[node.a].token, (std::uint32_t)ast[node.a].kind);
+                        result = target(dest);
+                        break;
+                    }
+                    int reg = fs->top ? -1 : local_of(symbol_of(node.a));
+                    result = expr(node.b, reg >= 0 ? reg : dest);
+                    if (reg < 0) store(node.a, result);
+                    else result = move(reg, dest);
+                    break;
+                }
+
+                case NodeKind::CALL: {
+                    // callee and arguments in a row, the result where the callee was
+                    std::uint8_t base = alloc();
+                    expr(ast.list(node)[0], base);
+                    if (node.b - 1 > UINT8_MAX) error(DiagCode::TOO_MANY_ARGUMENTS, node.token, UINT8_MAX);
+                    for (std::uint32_t i = 1; i < node.b; i++) expr(ast.list(node)[i], alloc());
+                    token = node.token;
+                    emit(Instr::abc(Opcode::CALL, base, (std::uint8_t)(node.b - 1)));
+                    fs->next = base + 1;
+                    result = base;
+                    if (dest >= 0 && dest != base) {
+                        result = move(base, dest);
+                        fs->next = mark;
+                    }
+                    break;
+                }
+
+                case NodeKind::ERROR:
+                    result = target(dest);
+                    emit(Instr::abc(Opcode::LOADNIL, result));
+                    break;
+
+                default:
+                    error(DiagCode::UNSUPPORTED, node.token, (std::uint32_t)node.kind);
+                    result = target(dest);
+            }
+            --depth;
+            token = outer;
+            return result;
+        }
+
+        // whether evaluating the tree at root can assign to a name
+        bool assigns(std::uint32_t root) {
+            bool found = false;
+            each_node(root, [&](std::uint32_t, const Node& node) { found |= node.kind == NodeKind::ASSIGN; });
+            return found;
+        }
+
+        // the left operand of a binary node, in left, copied out of its
+        // local's register if the right operand could assign to that local first
+        std::uint8_t left_operand(const Node& node, std::uint8_t left, std::uint32_t mark) {
+            if (left < mark && assigns(node.b)) left = move(left, alloc());
+            return left;
+        }
+
+        // 1 + 1 + ... + 1 nests down the left as deep as it is long, so the
+        // left operands are walked with a stack and each binary finished on
+        // the way back up, instead of recursing through expr
+        std::uint8_t binary(const Node& node, int dest, std::uint32_t mark) {
+            std::vector<const Node*> spine{ &node };
+            while (ast[spine.back()->a].kind == NodeKind::BINARY) spine.push_back(&ast[spine.back()->a]);
+            token = spine.back()->token;
+            std::uint8_t left = expr(spine.back()->a);
+            for (std::size_t i = spine.size(); i--;) {
+                token = spine[i]->token;
+                left = operation(*spine[i], left, i ? -1 : dest, mark);
+            }
+            return left;
+        }
+
+        // a binary node's instruction, its left operand already in a register
+        std::uint8_t operation(const Node& node, std::uint8_t left, int dest, std::uint32_t mark) {
+            // x + 1 and x - 1 are one instruction
+            const Node& right = ast[node.b];
+            if ((node.op == Op::ADD || node.op == Op::SUB) && right.kind == NodeKind::LITERAL
+                && lex.tokens()[right.token].code() == TokenCode::INT) {
+                std::int64_t value = lex.integer(lex.tokens()[right.token].value<std::uint32_t>());
+                if (node.op == Op::SUB) value = -value;
+                if (value >= INT8_MIN && value <= INT8_MAX) {
+                    fs->next = mark;
+                    std::uint8_t d = target(dest);
+                    emit(Instr::abc(Opcode::ADDI, d, left, (std::uint8_t)(std::int8_t)value));
+                    return d;
+                }
+            }
+
+            left = left_operand(node, left, mark);
+            std::uint8_t other = expr(node.b);
+            fs->next = mark;
+            std::uint8_t d = target(dest);
+            Opcode op = Opcode::ADD;
+            switch (node.op) {
+                case Op::ADD: op = Opcode::ADD; break;
+                case Op::SUB: op = Opcode::SUB; break;
+                case Op::MUL: op = Opcode::MUL; break;
+                case Op::DIV: op = Opcode::DIV; break;
+                case Op::SHL: op = Opcode::SHL; break;
+                case Op::SHR: op = Opcode::SHR; break;
+                case Op::EQ: op = Opcode::EQ; break;
+                case Op::NEQ: op = Opcode::NEQ; break;
+                case Op::LT: op = Opcode::LT; break;
+                case Op::LTEQ: op = Opcode::LTEQ; break;
+                // a > b is b < a
+                case Op::GT: op = Opcode::LT; std::swap(left, other); break;
+                case Op::GTEQ: op = Opcode::LTEQ; std::swap(left, other); break;
+                default: break;
+            }
+            emit(Instr::abc(op, d, left, other));
+            return d;
+        }
+
+        // jumps if cond's truth is when. comparisons become one compare and
+        // branch, the rest a test of the value. returns the jump to patch
+        std::size_t branch(std::uint32_t cond, bool when) {
+            const Node& node = ast[cond];
+            std::uint32_t outer = token;
+            token = node.token;
+            std::uint32_t mark = fs->next;
+            std::size_t jump;
+
+            if (node.kind == NodeKind::UNARY && node.op == Op::NOT) {
+                jump = branch(node.a, !when);
+            } else if (node.kind == NodeKind::BINARY && node.op >= Op::EQ && node.op <= Op::GTEQ) {
+                std::uint8_t left = left_operand(node, expr(node.a), mark);
+                std::uint8_t right = expr(node.b);
+                fs->next = mark;
+                Opcode op = Opcode::JEQ;
+                switch (node.op) {
+                    case Op::EQ: op = Opcode::JEQ; break;
+                    case Op::NEQ: op = Opcode::JNEQ; break;
+                    case Op::LT: op = Opcode::JLT; break;
+                    case Op::LTEQ: op = Opcode::JLTEQ; break;
+                    case Op::GT: op = Opcode::JLT; std::swap(left, right); break;
+                    default: op = Opcode::JLTEQ; std::swap(left, right); break;
+                }
+                emit(Instr::abc(op, left, right, when));
+                jump = emit(Instr::asbx(Opcode::JMP, 0, 0));
+            } else {
+                std::uint8_t value = expr(cond);
+                fs->next = mark;
+                jump = emit(Instr::asbx(when ? Opcode::JMPT : Opcode::JMPF, value, 0));
+            }
+            token = outer;
+            return jump;
+        }
+
+        // the condition is compiled twice, once to skip the loop and once
+        // at the bottom of the body, so an iteration is a single branch
+        void loop(std::uint32_t cond, std::uint32_t body) {
+            std::size_t skip = branch(cond, false);
+            std::size_t top = here();
+            fs->loops.emplace_back();
+            stmt(body);
+            std::size_t test = here();
+            patch(branch(cond, true), top);
+            Loop done = std::move(fs->loops.back());
+            fs->loops.pop_back();
+            patch_all(done.continues, test);
+            patch_all(done.breaks, here());
+            patch(skip, here());
+        }
+
+        // for (i = start, limit) and for (i = start, limit, step), limit included
+        void numeric_for(const Node& node) {
+            auto items = ast.list(node);
+            const Node& init = ast[items[0]];
+            std::uint8_t base = alloc();
+            alloc(); alloc();
+            expr(init.b, base);
+            expr(items[1], base + 1);
+            if (node.b == 4) expr(items[2], base + 2);
+            else emit(Instr::asbx(Opcode::LOADI, base + 2, 1));
+            token = node.token;
+            std::size_t prep = emit(Instr::asbx(Opcode::FORPREP, base, 0));
+
+            std::size_t top = here();
+            store(init.a, base);
+            fs->loops.emplace_back();
+            stmt(items[node.b - 1]);
+            std::size_t next = here();
+            token = node.token;
+            patch(emit(Instr::asbx(Opcode::FORLOOP, base, 0)), top);
+            patch(prep, here());
+            Loop done = std::move(fs->loops.back());
+            fs->loops.pop_back();
+            patch_all(done.continues, next);
+            patch_all(done.breaks, here());
+        }
+
+        void stmt(std::uint32_t index) {
+            if (index == NO_NODE) return;
+            const Node& node = ast[index];
+            std::uint32_t outer = token;
+            token = node.token;
+            std::uint32_t mark = fs->next;
+
+            switch (node.kind) {
+                case NodeKind::BLOCK:
+                    for (std::uint32_t child : ast.list(node)) stmt(child);
+                    break;
+
+                case NodeKind::SEQ:
+                    for (std::uint32_t child : ast.list(node)) {
+                        expr(child);
+                        fs->next = mark;
+                    }
+                    break;
+
+                case NodeKind::IF: {
+                    auto items = ast.list(node);
+                    std::size_t skip = branch(items[0], false);
+                    stmt(items[1]);
+                    if (node.b == 3) {
+                        std::size_t over = emit(Instr::asbx(Opcode::JMP, 0, 0));
+                        patch(skip, here());
+                        stmt(items[2]);
+                        patch(over, here());
+                    } else {
+                        patch(skip, here());
+                    }
+                    break;
+                }
+
+                case NodeKind::WHILE:
+                    loop(node.a, node.b);
+                    break;
+
+                case NodeKind::FOR: {
+                    auto items = ast.list(node);
+                    if (node.b == 2) {
+                        loop(items[0], items[1]);
+                    } else if ((node.b == 3 || node.b == 4) && ast[items[0]].kind == NodeKind::ASSIGN
+                        && ast[ast[items[0]].a].kind == NodeKind::NAME) {
+                        numeric_for(node);
+                    } else {
+                        error(DiagCode::BAD_FOR, node.token);
+                    }
+                    break;
+                }
+
+                case NodeKind::RET:
+                    if (node.a == NO_NODE) emit(Instr::abc(Opcode::RET0, 0));
+                    else emit(Instr::abc(Opcode::RET, expr(node.a)));
+                    break;
+
+                case NodeKind::BREAK:
+                case NodeKind::CONTINUE: {
+                    bool is_break = node.kind == NodeKind::BREAK;
+                    if (fs->loops.empty()) {
+                        error(DiagCode::OUTSIDE_LOOP, node.token, (std::uint32_t)lex.tokens()[node.token].code());
+                        break;
+                    }
+                    std::size_t jump = emit(Instr::asbx(Opcode::JMP, 0, 0));
+                    (is_break ? fs->loops.back().breaks : fs->loops.back().continues).push_back(jump);
+                    break;
+                }
+
+                case NodeKind::FUNC:
+                    if (!hoisted.count(index)) define(index);
+                    break;
+
+                case NodeKind::GET:   // modules are linked in before
+                case NodeKind::ERROR: // reported by the parser
+                    break;
+
+                default:
+                    expr(index);
+            }
+            fs->next = mark;
+            token = outer;
+        }
+
+        // compiles a func and binds it to its (global) name
+        void define(std::uint32_t index) {
+            const Node& node = ast[index];
+            std::uint32_t compiled = function(node);
+            std::uint32_t name = ast.list(node)[1];
+            if (name == NO_NODE) return;
+            std::uint32_t outer = token;
+            token = node.token;
+            std::uint8_t reg = alloc();
+            emit(Instr::abx(Opcode::LOADK, reg, constant(Value::of(ValueType::FUNCTION, compiled))));
+            emit(Instr::abx(Opcode::SETGLOBAL, reg, global_of(symbol_of(name))));
+            fs->next = reg;
+            token = outer;
+        }
+
+        // list: return type, name, params..., body
+        std::uint32_t function(const Node& node) {
+            auto items = ast.list(node);
+            std::uint32_t index = (std::uint32_t)out.functions.size();
+            out.functions.emplace_back();
+
+            FunctionState state(false);
+            if (items[1] != NO_NODE) {
+                TextView name = lex.symbols().name(symbol_of(items[1]));
+                state.fn.name.assign(name.data(), name.size());
+            }
+            FunctionState* outer = fs;
+            std::uint32_t outer_token = token;
+            fs = &state;
+            token = node.token;
+
+            for (std::uint32_t i = 2; i + 1 < node.b; i++) {
+                const Node& param = ast[items[i]];
+                if (param.kind != NodeKind::PARAM) continue;
+                // a second param of the same name gets a register all the same
+                std::uint8_t reg = alloc();
+                state.locals.push_back({ symbol_of(param.b), reg });
+            }
+            state.fn.params = (std::uint8_t)state.next;
+            std::uint32_t body = items[node.b - 1];
+            each_node(body, [&](std::uint32_t, const Node& n) {
+                if (n.kind == NodeKind::ASSIGN && ast[n.a].kind == NodeKind::NAME) declare(symbol_of(n.a));
+            });
+
+            stmt(body);
+            emit(Instr::abc(Opcode::RET0, 0));
+            fs = outer;
+            token = outer_token;
+            out.functions[index] = std::move(state.fn);
+            return index;
+        }
+
+        public:
+            Compiler(Bytecode& out, const Ast& ast, const LexOutput& lex, Diagnostics& diags)
+                : out(out), ast(ast), lex(lex), diags(diags),
+                  true_symbol(lex.symbols().find("true", 4)), false_symbol(lex.symbols().find("false", 5)),
+                  nil_symbol(lex.symbols().find("nil", 3)) {}
+
+            // function 0 runs every source's top level in order, after
+            // defining the funcs at top level of all of them
+            bool program() {
+                out.functions.emplace_back();
+                FunctionState state(true);
+                state.fn.name = "(top level)";
+                fs = &state;
+
+                const Node& root = ast[ast.root()];
+                for (std::uint32_t source : ast.list(root)) {
+                    for (std::uint32_t statement : ast.list(ast[source])) {
+                        if (ast[statement].kind != NodeKind::FUNC) continue;
+                        define(statement);
+                        hoisted.insert(statement);
+                    }
+                }
+                for (std::uint32_t source : ast.list(root)) {
+                    for (std::uint32_t statement : ast.list(ast[source])) stmt(statement);
+                }
+                emit(Instr::abc(Opcode::RET0, 0));
+                out.functions[0] = std::move(state.fn);
+                fs = nullptr;
+                return !failed;
+            }
+    };
+}
+
+bool compile_bytecode(Bytecode& into, const Ast& ast, const LexOutput& lex, Diagnostics& diags) {
+    TRACE_SPAN("compile bytecode");
+    into = {};
+    if (ast.root() == NO_NODE) return false;
+    return Compiler(into, ast, lex, diags).program();
+}
@@ -0,0 +1,37 @@
+#include <lang/diagnostics.hpp>
+
+#include <cstdio>
+#include <lang/dlex.hpp>
+#include <lang/parser.hpp>
+
+static const char* format_of(DiagCode code) {
+    switch (code) {
+#define DIAG(code, format) case DiagCode::code: return format;
+        DOYT_DIAGNOSTICS(DIAG)
+#undef DIAG
+    }
+    return "?";
+}
+
+std::ostream& Diagnostics::print(std::ostream& stream, const Diagnostic& diag) {
+    int arg = 0;
+    for (const char* f = format_of(diag.code); *f; f++) {
+        if (*f != '%' || !f[1] || arg > 1) { stream << *f; continue; }
+
+        std::uint32_t value = diag.args[arg++];
+        switch (*++f) {
+            case 't': stream << token_text((TokenCode)value); break;
+            case 'k': stream << node_name((NodeKind)value); break;
+            case 'c': {
+                unsigned char c = (unsigned char)value;
+                if (c >= 0x20 && c < 0x7f) { stream << c; break; }
+                char hex[8];
+                std::snprintf(hex, sizeof(hex), "\\x%02x", c);
+                stream << hex;
+                break;
+            }
+            default: stream << value;
+        }
+    }
+    return stream;
+}
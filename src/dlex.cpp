@@ -1,27 +1,31 @@
 #include <lang/dlex.hpp>
 
-#include <cctype>
+#include <algorithm>
+#include <charconv>
 #include <cmath>
 #include <lang/dlex.hpp>
+#include <lang/scan.hpp>
+#include <lang/trace.hpp>
+#include <atomic>
+#include <bit>
+#include <string>
+#include <memory>
 #include <stdexcept>
+#include <thread>
 
 #define TOKPRINT(T) case T: stream << #T; break;
-std::ostream& Token::print(std::ostream& stream) const {
+std::ostream& Token::print(std::ostream& stream, const LexOutput& lex) const {
     using enum TokenCode;
     switch (tcode) {
         TOKPRINT(_EOF)
-        TOKPRINT(RET)
-        TOKPRINT(FUNC)
-        TOKPRINT(GET)
-        TOKPRINT(IF)
-        TOKPRINT(ELSE)
-        TOKPRINT(WHILE)
-        TOKPRINT(BREAK)
-        TOKPRINT(CONTINUE)
+#define KEYWORD(code, text) TOKPRINT(code)
+        DOYT_KEYWORDS(KEYWORD)
+#undef KEYWORD
         
-        case IDENTITY: stream << "Identity'" << value<TextView>().data() << "'"; break;;
-        case NUMBER: stream << "Number'" << value<float>() << "'"; break;;
-        case STRING: stream << "String'" << value<TextView>().data() << "'"; break;;
+        case IDENTITY: stream << "Identity'" << lex.symbols().name(value<std::uint32_t>()) << "'"; break;;
+        case INT: stream << "Int'" << lex.integer(value<std::uint32_t>()) << "'"; break;;
+        case FLOAT: stream << "Float'" << lex.number(value<std::uint32_t>()) << "'"; break;;
+        case STRING: stream << "String'" << lex.string(value<std::uint32_t>()) << "'"; break;;
         case CHAR: stream << "Char'" << value<char>() << "'"; break;;
         case BOOL: stream << "Bool'" << value<bool>() << "'"; break;;
         
@@ -55,46 +59,271 @@ std::ostream& Token::print(std::ostream& stream) const {
 }
 #undef TOKPRINT
 
-int int_parse(const char*& ptr) {
-    int value = 0, mul = 1;
-    char c = *ptr;
-    if (c == '-') { c = *(++ptr); mul = -1; }
-    while (isdigit(c)) {
-        value = value*10 + c - '0';
-        c = *(++ptr);
+const char* token_text(TokenCode code) {
+    using enum TokenCode;
+    switch (code) {
+        case _EOF: return "the end of the file";
+#define KEYWORD(code, text) case code: return text;
+        DOYT_KEYWORDS(KEYWORD)
+#undef KEYWORD
+        case IDENTITY: return "a name";
+        case INT: case FLOAT: return "a number";
+        case STRING: return "a string";
+        case CHAR: return "a character";
+        case BOOL: return "a boolean";
+        case NIL: return "nil";
+        case PARAN_L: return "'('";
+        case PARAN_R: return "')'";
+        case CURLY_L: return "'{'";
+        case CURLY_R: return "'}'";
+        case BRACK_L: return "'['";
+        case BRACK_R: return "']'";
+        case PLUS: return "'+'";
+        case MINUS: return "'-'";
+        case STAR: return "'*'";
+        case SLASH: return "'/'";
+        case DOT: return "'.'";
+        case COMMA: return "','";
+        case SEMI: return "';'";
+        case EXC: return "'!'";
+        case GTEQ: return "'>='";
+        case LTEQ: return "'<='";
+        case EQ2: return "'=='";
+        case EQ: return "'='";
+        case GT2: return "'>>'";
+        case LT2: return "'<<'";
+        case GT: return "'>'";
+        case LT: return "'<'";
+        case NEQ: return "'!='";
+        default: return "a token";
     }
-    return value * mul;
 }
 
-int uint_parse(const char*& ptr) {
-    int value = 0;
-    char c = *ptr;
-    while (isdigit(c)) {
-        value = value*10 + c - '0';
-        c = *(++ptr);
+// number literals. integers are accumulated 8 digits at a time where the
+// source allows it, floats go through from_chars (no pow, correctly rounded).
+// '_' may separate two digits, anywhere else it's reported
+namespace {
+    inline bool is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+
+    // the 8 bytes at p are all ascii digits
+    inline bool swar_digits(std::uint64_t w) {
+        return ((w & 0xF0F0F0F0F0F0F0F0ull) | (((w + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+    }
+
+    // the value of 8 ascii digits, first digit in the lowest byte
+    inline std::uint32_t swar_value(std::uint64_t w) {
+        w -= 0x3030303030303030ull;
+        w = (w * 10) + (w >> 8);
+        return (std::uint32_t)((((w & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+            (((w >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32);
+    }
+
+    // like the scan kernels, an 8 byte load may only run to the end of the
+    // aligned 64 byte block, where the source's terminator could sit
+    inline bool can_load8(const char* p) { return ((std::uintptr_t)p & 63) <= 56; }
+
+    // a separator goes between two digits. the first one that doesn't is
+    // kept in misplaced, p[-1] is part of the literal
+    inline void check_separator(const char* p, bool (*digit)(char), const char*& misplaced) {
+        if (!misplaced && (!digit(p[-1]) || !digit(p[1]))) misplaced = p;
+    }
+
+    // decimal digits and separators, false if the value doesn't fit
+    bool decimal_parse(const char*& p, std::uint64_t& value, const char*& misplaced) {
+        bool fits = true;
+        for (;;) {
+            std::uint64_t w;
+            while (std::endian::native == std::endian::little && can_load8(p) && (std::memcpy(&w, p, 8), swar_digits(w))) {
+                fits &= !__builtin_mul_overflow(value, 100000000ull, &value);
+                fits &= !__builtin_add_overflow(value, swar_value(w), &value);
+                p += 8;
+            }
+            // the tail, fewer than 8 digits unless the block ended
+            for (; is_digit(*p); ++p) {
+                fits &= !__builtin_mul_overflow(value, 10ull, &value);
+                fits &= !__builtin_add_overflow(value, (unsigned)(*p - '0'), &value);
+            }
+            if (*p != '_') return fits;
+            check_separator(p++, is_digit, misplaced);
+        }
+    }
+
+    template <unsigned Bits> bool radix_digit(char c) {
+        if (Bits == 1) return c == '0' || c == '1';
+        return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+    }
+
+    // 0x and 0b bodies, up to 64 bits so 0xFFFFFFFFFFFFFFFF is -1. false if
+    // a digit would shift set bits out
+    template <unsigned Bits> bool radix_parse(const char*& p, std::uint64_t& value, const char*& misplaced) {
+        bool fits = true;
+        for (;; ++p) {
+            unsigned char c = *p, d;
+            if (c == '_') { check_separator(p, radix_digit<Bits>, misplaced); continue; }
+            if (is_digit(c)) d = c - '0';
+            else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') d = (c | 0x20) - 'a' + 10;
+            else return fits;
+            if (d >> Bits) return fits;
+            fits &= !(value >> (64 - Bits));
+            value = value << Bits | d;
+        }
+    }
+
+    // from_chars gives up on values past double's range, they are inf or 0
+    // depending on the decimal exponent of their leading digit
+    double out_of_range(const char* p, const char* end) {
+        long magnitude = 0;
+        bool seen = false, fraction = false;
+        for (; p < end && (*p | 0x20) != 'e'; ++p) {
+            if (*p == '.') fraction = true;
+            else if (fraction && !seen) { --magnitude; seen = *p != '0'; }
+            else if (!fraction && seen) ++magnitude;
+            else seen = *p != '0';
+        }
+        if (p < end) ++p; // the e
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) ++p;
+        long exponent = 0;
+        for (; p < end && exponent < 100000; ++p) exponent = exponent * 10 + (*p - '0');
+        return magnitude + (negative ? -exponent : exponent) > 0 ? HUGE_VAL : 0.0;
+    }
+
+    double float_parse(const char* begin, const char* end) {
+        // from_chars doesn't take separators, those are stripped into a copy
+        char stack[128];
+        std::string heap;
+        const char* text = begin;
+        if (std::memchr(begin, '_', end - begin)) {
+            char* to = end - begin <= (std::ptrdiff_t)sizeof(stack) ? stack : (heap.resize(end - begin), heap.data());
+            text = to;
+            for (const char* c = begin; c < end; c++) if (*c != '_') *to++ = *c;
+            end = to;
+        }
+
+        double value = 0;
+        auto [at, err] = std::from_chars(text, end, value);
+        if (err == std::errc::result_out_of_range) value = out_of_range(text, end);
+        return value;
+    }
+
+    // src is on a digit, or on a '.' followed by one. wide is set for a 0x
+    // or 0b literal past 64 bits, misplaced to the first separator not
+    // between two digits (or left alone)
+    TokenCode number_parse(const char*& src, std::uint64_t& int_value, double& float_value, bool& wide, const char*& misplaced) {
+        const char* begin = src;
+        int_value = 0;
+
+        if (src[0] == '0' && ((src[1] | 0x20) == 'x' || (src[1] | 0x20) == 'b')) {
+            bool hex = (src[1] | 0x20) == 'x';
+            const char* digits = src + 2;
+            while (*digits == '_') ++digits;
+            if (hex ? radix_digit<4>(*digits) : radix_digit<1>(*digits)) {
+                if (digits > src + 2) misplaced = src + 2;
+                src = digits;
+                wide = !(hex ? radix_parse<4>(src, int_value, misplaced) : radix_parse<1>(src, int_value, misplaced));
+                return TokenCode::INT;
+            }
+        }
+
+        bool fits = decimal_parse(src, int_value, misplaced);
+        bool is_float = false;
+        if (*src == '.' && is_digit(src[1])) {
+            is_float = true;
+            ++src;
+            std::uint64_t ignored = 0;
+            decimal_parse(src, ignored, misplaced);
+        }
+        if ((*src | 0x20) == 'e') {
+            const char* exp = src + 1;
+            if (*exp == '+' || *exp == '-') ++exp;
+            if (is_digit(*exp)) {
+                is_float = true;
+                src = exp;
+                std::uint64_t ignored = 0;
+                decimal_parse(src, ignored, misplaced);
+            }
+        }
+
+        // decimal integers too big for 64 bits become floats
+        if (!is_float && fits && int_value <= (std::uint64_t)INT64_MAX) return TokenCode::INT;
+        float_value = float_parse(begin, src);
+        return TokenCode::FLOAT;
     }
-    return value;
 }
 
-float float_parse(const char*& ptr) {
-    int i_val = 0;
-    i_val = int_parse(ptr);
+// keyword lookup is a perfect hash over (length, first char, last char),
+// found at compile time from DOYT_KEYWORDS, so an identifier costs one table
+// probe and at most one compare
+namespace {
+    struct Keyword { const char* text = nullptr; std::size_t len = 0; TokenCode code = TokenCode::IDENTITY; };
+
+    constexpr Keyword keyword_list[] = {
+#define KEYWORD(code, text) { text, sizeof(text) - 1, TokenCode::code },
+        DOYT_KEYWORDS(KEYWORD)
+#undef KEYWORD
+    };
+
+    constexpr unsigned KEYWORD_SLOTS = 32;
+    struct KeywordHash { unsigned first = 0, last = 0; };
+
+    constexpr unsigned keyword_slot(KeywordHash h, std::size_t len, char first, char last) {
+        return ((unsigned char)first * h.first + (unsigned char)last * h.last + (unsigned)len) & (KEYWORD_SLOTS - 1);
+    }
+
+    constexpr KeywordHash find_keyword_hash() {
+        for (unsigned a = 1; a < 64; a++) for (unsigned b = 1; b < 64; b++) {
+            bool taken[KEYWORD_SLOTS] = {}, ok = true;
+            for (const Keyword& kw : keyword_list) {
+                unsigned slot = keyword_slot({a, b}, kw.len, kw.text[0], kw.text[kw.len - 1]);
+                if (taken[slot]) { ok = false; break; }
+                taken[slot] = true;
+            }
+            if (ok) return {a, b};
+        }
+        return {};
+    }
+
+    constexpr KeywordHash keyword_hash = find_keyword_hash();
+    static_assert(keyword_hash.first, "no perfect hash for DOYT_KEYWORDS, raise KEYWORD_SLOTS");
+
+    struct KeywordTable {
+        Keyword slots[KEYWORD_SLOTS] = {};
+        std::size_t min_len = ~std::size_t(0), max_len = 0;
+    };
+
+    constexpr KeywordTable make_keyword_table() {
+        KeywordTable table;
+        for (const Keyword& kw : keyword_list) {
+            table.slots[keyword_slot(keyword_hash, kw.len, kw.text[0], kw.text[kw.len - 1])] = kw;
+            if (kw.len < table.min_len) table.min_len = kw.len;
+            if (kw.len > table.max_len) table.max_len = kw.len;
+        }
+        return table;
+    }
 
-    if (*ptr != '.') return (float)i_val; 
-    
-    const char *d_ptr = ++ptr;
-    int d_val = uint_parse(ptr);
-    float val = (float)i_val + (float)d_val * std::pow(10, d_ptr - ptr);
-    if ((*ptr | 0x20) != 'e') return val;
-    
-    if (*(++ptr) == '+') ++ptr;
-    int e_val = int_parse(ptr);
-    return val * std::pow(10, e_val);
+    constexpr KeywordTable keyword_table = make_keyword_table();
 }
 
-TokenCode match_punctuation(char a, char& b, const char*& src) {
+// IDENTITY if not a keyword
+inline TokenCode match_keyword(const char* ident, std::size_t len) {
+    if (len < keyword_table.min_len || len > keyword_table.max_len) return TokenCode::IDENTITY;
+    const Keyword& kw = keyword_table.slots[keyword_slot(keyword_hash, len, ident[0], ident[len - 1])];
+    if (kw.len == len && std::memcmp(kw.text, ident, len) == 0) return kw.code;
+    return TokenCode::IDENTITY;
+}
+
+// advances src past the punctuation if matched
+TokenCode match_punctuation(const char*& src) {
     using enum TokenCode;
+    char a = *src, b = src[1];
+    ++src;
     switch (a) {
+        case '(': return PARAN_L;
+        case ')': return PARAN_R;
+        case '{': return CURLY_L;
+        case '}': return CURLY_R;
+        case '[': return BRACK_L;
+        case ']': return BRACK_R;
         case '+': return PLUS;
         case '-': return MINUS;
         case '*': return STAR;
@@ -103,98 +332,508 @@ TokenCode match_punctuation(char a, char& b, const char*& src) {
         case ',': return COMMA;
         case ';': return SEMI;
         case '>': switch (b) {
-            case '=': b = *(++src); return GTEQ;
-            case '>': b = *(++src); return GT2;
+            case '=': ++src; return GTEQ;
+            case '>': ++src; return GT2;
             default: return GT;
         }
         case '<': switch (b) {
-            case '=': b = *(++src); return LTEQ;
-            case '<': b = *(++src); return LT2;
+            case '=': ++src; return LTEQ;
+            case '<': ++src; return LT2;
             default: return LT;
         }
         case '!': switch (b) {
-            case '=': b = *(++src); return NEQ;
+            case '=': ++src; return NEQ;
             default: return EXC;
         }
         case '=': switch(b) {
-            case '=': b = *(++src); return EQ2;
+            case '=': ++src; return EQ2;
             default: return EQ;
         }
-        default: return _EOF;
+        default: --src; return _EOF;
     }
 };
 
-LexOutput tokenize(const char** src_set, int src_count, int flags) {
-    LexOutput lexout = LexOutput();
-    
-    while (src_count--) {
-        const char* src = *(src_set++);
-        char b = *(src);
-        while (b) {
-            char a = b;
-            b = *(++src);
+inline std::uint64_t Lexer::bit_of(const char* p) {
+    const char* base = (const char*)((std::uintptr_t)p & ~(std::uintptr_t)63);
+    if (base != block) {
+        block = base;
+        scan::classify(base, masks);
+    }
+    return 1ull << (p - base);
+}
 
-            if (isspace(a)) continue;
+inline const char* Lexer::skip(const char* p, std::uint64_t scan::Masks::* cls) {
+    for (;;) {
+        std::uint64_t from = -bit_of(p); // before masks is read, it may be the next block's
+        std::uint64_t rest = ~(masks.*cls) & from;
+        if (rest) return block + std::countr_zero(rest);
+        p = block + 64;
+    }
+}
 
-            if (a == '/' && b == '/') {
-                while (b && b != '\n') b = *(++src);
-                continue;
+bool Lexer::next(Token& tok) {
+    for (char a; src < stop && (a = *src);) {
+        // the block's masks tell what starts here, whitespace runs are
+        // skipped with a bit scan and comment bodies by the scanner
+        std::uint64_t bit = bit_of(src);
+        if (masks.space & bit) { src = skip(src, &scan::Masks::space); continue; }
+        char b = src[1];
+
+        if (a == '/' && b == '/') {
+            src = scan::find_byte(src + 2, '\n');
+            continue;
+        }
+        token_start = src;
+
+        // allows numbers begining with .
+        if ((masks.digit & bit) || (a == '.' && is_digit(b))) {
+            std::uint64_t int_value;
+            double float_value;
+            bool wide = false;
+            const char* misplaced = nullptr;
+            if (number_parse(src, int_value, float_value, wide, misplaced) == TokenCode::INT) {
+                tok = Token(TokenCode::INT, out.add_int((std::int64_t)int_value));
+            } else {
+                tok = Token(TokenCode::FLOAT, out.add_float(float_value));
             }
+            // in offset order, like every lexer report
+            if (wide) out.diagnostic_sink.report(DiagCode::WIDE_NUMBER, file, offset());
+            if (misplaced) out.diagnostic_sink.report(DiagCode::BAD_SEPARATOR, file, offset_of(misplaced));
+            return true;
+        }
 
-            // allows numbers begining with .
-            if ((a == '.' && isdigit(b)) || isdigit(a)) {
-                // temporarily just single NUMBER token
-                lexout.emit(TokenCode::NUMBER, float_parse(--src));
-                b = *src;
-                continue;
+        if (masks.punct & bit) {
+            TokenCode punct = match_punctuation(src);
+            if (punct != TokenCode::_EOF) {
+                tok = Token(punct);
+                return true;
             }
+        }
 
-            {
-                TokenCode punct = match_punctuation(a, b, src);
-                if (punct != TokenCode::_EOF) {
-                    lexout.emit(punct);
-                    b = *(src); continue;
-                } 
+        if (masks.quote & bit) {
+            const char* start = ++src;
+            // using "", always parses as string
+            // using '', parses as string if over 1 character
+            src = scan::find_byte(start, a);
+            if (a == '\'' && src - start == 1) {
+                tok = Token(TokenCode::CHAR, *start);
+            } else {
+                tok = Token(TokenCode::STRING, out.add_string(file, offset_of(start), (std::uint32_t)(src - start)));
             }
+            if (*src) ++src; // skips closing term
+            else out.diagnostic_sink.report(DiagCode::UNTERMINATED_STRING, file, offset());
+            return true;
+        }
 
-            if (a == '\'' || a == '"') {
-                const char* start = src;
-                // using "", always parses as string
-                // using '', parses as string if over 1 character
-                char term = a;
-                while (b != term && b) b = *(++src);
-                int len = src - start;
-                if (term == '\'' && len == 1) {
-                    lexout.emit(TokenCode::CHAR, *(src-1));
-                } else {
-                    lexout.emit(TokenCode::STRING, 
-                        TextView(start + 1, src)
-                    );
-                }
-                b = *(++src); // skips closing term
+        // digits went above
+        if (masks.ident & bit) {
+            const char* ident_start = src;
+            src = skip(src + 1, &scan::Masks::ident);
+            TokenCode keyword = match_keyword(ident_start, src - ident_start);
+            if (keyword != TokenCode::IDENTITY) { tok = Token(keyword); return true; }
+
+            tok = Token(TokenCode::IDENTITY, out.symbol_table.intern(ident_start, src - ident_start));
+            return true;
+        }
+
+        // unrecognised, skipped. a run of them is one report
+        std::uint32_t at = offset_of(src);
+        Diagnostic* prev = out.diagnostic_sink.size() > first_report ? out.diagnostic_sink.last() : nullptr;
+        if (prev && (prev->code == DiagCode::UNKNOWN_CHAR || prev->code == DiagCode::UNKNOWN_CHARS)
+            && prev->file == file && prev->offset + prev->args[1] == at) {
+            prev->code = DiagCode::UNKNOWN_CHARS;
+            ++ prev->args[1];
+        } else {
+            out.diagnostic_sink.report(DiagCode::UNKNOWN_CHAR, file, at, (unsigned char)a, 1);
+        }
+        ++src;
+    }
+    return false;
+}
+
+const char* LexOutput::lex_source(const char* src, const char* stop, std::uint32_t offset, std::uint32_t file) {
+    Lexer lexer(*this, src, stop, offset, file);
+    Token tok;
+    while (lexer.next(tok)) {
+        token_pool.insert(tok);
+        offset_pool.insert(lexer.offset());
+    }
+    return lexer.position();
+}
+
+std::uint32_t LexOutput::lex_file(const char* src) {
+    TRACE_SPAN("lex file", (std::int64_t)file_ranges.size());
+    std::size_t first = count();
+    const char* end = lex_source(src, Lexer::NO_STOP, 0, (std::uint32_t)file_ranges.size());
+    file_ranges.push_back({ first, count() });
+    file_texts.push_back({ src, (std::uint32_t)(end - src) });
+    trace_pools();
+    return (std::uint32_t)(end - src);
+}
+
+void LexOutput::trace_pools() const {
+#if DOYT_TRACE
+    if (!trace::enabled()) return;
+    for (const PoolUsage& u : pool_usage()) trace::counter("pool bytes", u.name, (std::int64_t)u.reserved);
+#endif
+}
+
+void LexOutput::absorb(const LexOutput& shard, std::uint32_t file_base) {
+    diagnostic_sink.absorb(shard.diagnostic_sink, file_base);
+    std::vector<std::uint32_t> remap(shard.symbol_table.size());
+    for (std::uint32_t id = 0; id < remap.size(); id++) remap[id] = symbol_table.intern(shard.symbol_table.name(id));
+
+    std::uint32_t string_base = (std::uint32_t)string_table.size();
+    for (StringPiece piece : shard.string_table) {
+        piece.file += file_base;
+        string_table.insert(piece);
+    }
+    std::uint32_t int_base = (std::uint32_t)int_table.size();
+    for (std::size_t i = 0; i < shard.int_table.size(); i++) int_table.insert(shard.int_table[i]);
+    std::uint32_t float_base = (std::uint32_t)float_table.size();
+    for (std::size_t i = 0; i < shard.float_table.size(); i++) float_table.insert(shard.float_table[i]);
+
+    for (std::uint32_t slot : shard.free_strings) free_strings.insert(string_base + slot);
+    for (std::uint32_t slot : shard.free_ints) free_ints.insert(int_base + slot);
+    for (std::uint32_t slot : shard.free_floats) free_floats.insert(float_base + slot);
+
+    // a run at a time, an edited unit's pools have a gap
+    for (std::size_t i = 0; i < shard.count();) {
+        std::span<const Token> run = shard.token_pool.run(i, shard.count());
+        for (Token tok : run) {
+            if (tok.code() == TokenCode::IDENTITY) tok = Token(TokenCode::IDENTITY, remap[tok.value<std::uint32_t>()]);
+            if (tok.code() == TokenCode::STRING) tok = Token(TokenCode::STRING, string_base + tok.value<std::uint32_t>());
+            if (tok.code() == TokenCode::INT) tok = Token(TokenCode::INT, int_base + tok.value<std::uint32_t>());
+            if (tok.code() == TokenCode::FLOAT) tok = Token(TokenCode::FLOAT, float_base + tok.value<std::uint32_t>());
+            token_pool.insert(tok);
+        }
+        i += run.size();
+    }
+    for (std::size_t i = 0; i < shard.count();) {
+        std::span<const std::uint32_t> run = shard.offset_pool.run(i, shard.count());
+        for (std::uint32_t offset : run) offset_pool.insert(offset);
+        i += run.size();
+    }
+}
+
+std::uint32_t LexOutput::file_of(std::size_t token) const {
+    auto after = std::upper_bound(file_ranges.begin(), file_ranges.end(), token,
+        [](std::size_t token, const TokenRange& range) { return token < range.begin; });
+    return after == file_ranges.begin() ? 0 : (std::uint32_t)(after - file_ranges.begin() - 1);
+}
+
+void LexOutput::append(const LexOutput& unit) {
+    TRACE_SPAN("append unit", (std::int64_t)file_ranges.size());
+    // ours goes, the unit's _EOF takes its place
+    if (count()) {
+        token_pool.pop_back();
+        offset_pool.pop_back();
+    }
+    std::size_t first = count();
+    absorb(unit, (std::uint32_t)file_ranges.size());
+    file_ranges.push_back({ first, count() - 1 });
+    file_texts.insert(file_texts.end(), unit.file_texts.begin(), unit.file_texts.end());
+}
+
+// a piece of one source lexed on its own, assuming it starts outside of any
+// string or comment. exit is where its lexer stopped
+struct LexSlice {
+    const char* begin;
+    const char* end;
+    std::uint32_t file, offset; // which source, and where in it begin is
+    const char* exit = nullptr;
+};
+
+// no flags change how sources are lexed yet
+LexOutput tokenize(const SourceBuffer* src_set, std::size_t src_count, int, int jobs) {
+    LexOutput lexout;
+    LexOutput::lex_sources(lexout, src_set, src_count, jobs);
+    return lexout;
+}
+
+void tokenize(LexOutput& lexout, const SourceBuffer* src_set, std::size_t src_count, int, int jobs) {
+    lexout.reset();
+    LexOutput::lex_sources(lexout, src_set, src_count, jobs);
+}
+
+void LexOutput::lex_sources(LexOutput& lexout, const SourceBuffer* src_set, std::size_t src_count, int jobs) {
+    if (jobs <= 1) {
+        // nothing here allocates once lexout is warm
+        std::uint32_t end = 0;
+        for (std::size_t i = 0; i < src_count; i++) end = lexout.lex_file(src_set[i].data());
+        lexout.emit(TokenCode::_EOF, end);
+        return;
+    }
+
+    // small files are one slice each, big ones are cut at line starts into
+    // LEX_CHUNK_SIZE pieces. every slice lexes into its own shard, then the
+    // shards are merged in order, so tokens and symbol ids match the serial run
+    std::vector<LexSlice> slices;
+    std::vector<std::size_t> file_slices(src_count + 1);
+    for (std::size_t i = 0; i < src_count; i++) {
+        file_slices[i] = slices.size();
+        const char* src = src_set[i].data();
+        const char* end = src + src_set[i].size();
+        if (end - src < 2 * LEX_CHUNK_SIZE) { slices.push_back({ src, end, (std::uint32_t)i, 0 }); continue; }
+
+        while (src < end) {
+            const char* cut = end - src < 2 * LEX_CHUNK_SIZE ? end : scan::find_byte(src + LEX_CHUNK_SIZE, '\n');
+            if (cut < end) ++cut;
+            slices.push_back({ src, cut, (std::uint32_t)i, (std::uint32_t)(src - src_set[i].data()) });
+            src = cut;
+        }
+    }
+    file_slices[src_count] = slices.size();
+
+    std::unique_ptr<LexOutput[]> shards(new LexOutput[slices.size()]);
+    std::atomic<std::size_t> next = 0;
+    auto worker = [&] {
+        for (std::size_t i; (i = next++) < slices.size();) {
+            TRACE_SPAN("lex slice", (std::int64_t)i);
+            const LexSlice& slice = slices[i];
+            slices[i].exit = shards[i].lex_source(slice.begin, slice.end, slice.offset, slice.file);
+        }
+    };
+
+    if ((std::size_t)jobs > slices.size()) jobs = (int)slices.size();
+    std::vector<std::thread> workers;
+    for (int i = 1; i < jobs; i++) workers.emplace_back([&] { TRACE_THREAD("lex worker"); worker(); });
+    worker();
+    for (std::thread& t : workers) t.join();
+
+    for (std::size_t f = 0; f < src_count; f++) {
+        TRACE_SPAN("merge file", (std::int64_t)f);
+        std::size_t first = lexout.count();
+        const char* at = slices[file_slices[f]].begin;
+        for (std::size_t i = file_slices[f]; i < file_slices[f+1]; i++) {
+            const LexSlice& slice = slices[i];
+            // the guess holds if the previous slice stopped right at our start,
+            // or only whitespace lies between our start and where it stopped
+            if (at == slice.begin || (at > slice.begin && scan::skip_space(slice.begin) >= at)) {
+                lexout.absorb(shards[i]);
+                at = slice.exit;
                 continue;
             }
 
-            if (isalpha(a) || a == '_') {
-                const char* ident_start = src;
-                while (isalnum(b) || b == '_') b = *(++src);
-                TextView ident_view(ident_start, src-1);
-                if (ident_view == "return") { lexout.emit(TokenCode::RET); continue; }
-                if (ident_view == "func") { lexout.emit(TokenCode::FUNC); continue; }
-                if (ident_view == "get") { lexout.emit(TokenCode::GET); continue; }
-                if (ident_view == "if") { lexout.emit(TokenCode::IF); continue; }
-                if (ident_view == "else") { lexout.emit(TokenCode::ELSE); continue; }
-                if (ident_view == "while") { lexout.emit(TokenCode::WHILE); continue; }
-                if (ident_view == "break") { lexout.emit(TokenCode::BREAK); continue; }
-                if (ident_view == "continue") { lexout.emit(TokenCode::CONTINUE); continue; }
-
-                // temporary, identities will have an ID
-                lexout.emit(TokenCode::IDENTITY, ident_view);
+            // the previous slice ran into ours (a string crossing the seam),
+            // our shard started mid-token and is redone from where it ended
+            if (at >= slice.end) continue;
+            TRACE_SPAN("relex slice", (std::int64_t)i);
+            LexOutput redo;
+            at = redo.lex_source(at, slice.end, (std::uint32_t)(at - src_set[f].data()), (std::uint32_t)f);
+            lexout.absorb(redo);
+        }
+        lexout.file_ranges.push_back({ first, lexout.count() });
+        lexout.file_texts.push_back({ src_set[f].data(), (std::uint32_t)src_set[f].size() });
+        lexout.trace_pools();
+    }
+
+    // the _EOF sits at the end of the last source, like in the serial run
+    std::uint32_t end = src_count ? (std::uint32_t)src_set[src_count - 1].size() : 0;
+    lexout.emit(TokenCode::_EOF, end);
+}
+
+// how far past the end of a token the lexer may look before it knows the
+// token ended, "1e+5" reads 3 bytes past the 1 before splitting it from "e"
+#define LEX_LOOKAHEAD 3
+
+// moves the payloads of tokens, which were added to table from base on,
+// into free slots, then packs the rest down from base and cuts the table
+// there. what the lexer added for no token goes
+template <typename T>
+static void repack(Pool<T>& table, Pool<std::uint32_t>& free, std::uint32_t base, std::vector<Token>& tokens, TokenCode code) {
+    std::uint32_t packed = base;
+    for (Token& tok : tokens) {
+        if (tok.code() != code) continue;
+        std::uint32_t slot = packed;
+        if (free.size()) {
+            slot = free[free.size() - 1];
+            free.pop_back();
+        } else {
+            ++ packed;
+        }
+        table[slot] = table[tok.value<std::uint32_t>()];
+        tok = Token(code, slot);
+    }
+    while (table.size() > packed) table.pop_back();
+}
+
+TokenEdit relex(LexOutput& lex, std::size_t file, const SourceBuffer& source, TextEdit edit) {
+    TRACE_SPAN("relex", (std::int64_t)file);
+    TokenRange range = lex.file_ranges[file];
+    LexOutput::FileText& text = lex.file_texts[file];
+    auto real = [&](std::size_t token) { return lex.real_offset((std::uint32_t)file, lex.offset_pool[token]); };
+    std::uint32_t string_base = (std::uint32_t)lex.string_table.size();
+    std::uint32_t int_base = (std::uint32_t)lex.int_table.size();
+    std::uint32_t float_base = (std::uint32_t)lex.float_table.size();
+    std::int64_t delta = (std::int64_t)edit.new_end - edit.old_end;
+
+    // a token is left alone if the one after it starts LEX_LOOKAHEAD bytes
+    // before the edit, nothing it was lexed from changed. lexing restarts a
+    // token before the first one that isn't, since "0x__" looks further
+    std::size_t lo = range.begin, hi = range.end;
+    while (lo < hi) {
+        std::size_t mid = (lo + hi) / 2;
+        if (mid + 1 < range.end && real(mid + 1) + LEX_LOOKAHEAD <= edit.begin) lo = mid + 1;
+        else hi = mid;
+    }
+    std::size_t begin = lo > range.begin ? lo - 1 : lo;
+    std::uint32_t start = begin > range.begin ? real(begin) : 0;
+
+    // past the edit the texts agree, so once a new token starts where an old
+    // one did (moved by delta) the rest would come out the same
+    std::size_t reported = lex.diagnostic_sink.size();
+    std::vector<Token> tokens;
+    std::vector<std::uint32_t> offsets;
+    std::size_t old = begin; // the first old token not behind the lexer
+    Lexer lexer(lex, source.data() + start, Lexer::NO_STOP, start, (std::uint32_t)file);
+    Token tok;
+    for (;;) {
+        std::size_t before = lex.diagnostic_sink.size();
+        if (!lexer.next(tok)) { old = range.end; break; }
+        std::uint32_t at = lexer.offset();
+        if (at >= edit.new_end) {
+            std::int64_t was = at - delta;
+            while (old < range.end && real(old) < was) ++old;
+            if (old < range.end && real(old) == was) {
+                // what's reported for the token itself was for the old one too
+                while (lex.diagnostic_sink.size() > before && lex.diagnostic_sink.last()->offset >= at) {
+                    lex.diagnostic_sink.truncate(lex.diagnostic_sink.size() - 1);
+                }
+                break;
             }
         }
+        tokens.push_back(tok);
+        offsets.push_back(at);
     }
 
-    lexout.emit(TokenCode::_EOF);
+    for (std::size_t i = begin; i < old; i++) {
+        Token tok = lex.token_pool[i];
+        if (tok.code() == TokenCode::STRING) lex.free_strings.insert(tok.value<std::uint32_t>());
+        if (tok.code() == TokenCode::INT) lex.free_ints.insert(tok.value<std::uint32_t>());
+        if (tok.code() == TokenCode::FLOAT) lex.free_floats.insert(tok.value<std::uint32_t>());
+    }
+    repack(lex.string_table, lex.free_strings, string_base, tokens, TokenCode::STRING);
+    repack(lex.int_table, lex.free_ints, int_base, tokens, TokenCode::INT);
+    repack(lex.float_table, lex.free_floats, float_base, tokens, TokenCode::FLOAT);
 
-    return lexout;
-}
\ No newline at end of file
+    std::uint32_t old_stop = old < range.end ? real(old) : UINT32_MAX;
+    lex.diagnostic_sink.rebase((std::uint32_t)file, start, old_stop, delta, reported);
+
+    // the tokens before the new ones count from the start of the file, the
+    // ones after from its end. of the old ones only those between the
+    // previous edit and this one change sides, their strings with them
+    std::size_t end = range.end;
+    if (file + 1 == lex.file_ranges.size()) ++ end; // the _EOF sits at the end of the last file
+    std::size_t from_end = text.from_end < end - range.begin ? range.begin + text.from_end : end;
+    auto recount = [&](std::size_t from, std::size_t to, std::uint32_t by) {
+        for (std::size_t i = from; i < to;) {
+            std::span<std::uint32_t> run = lex.offset_pool.run(i, to);
+            for (std::size_t j = 0; j < run.size(); j++) {
+                run[j] += by;
+                Token tok = lex.token_pool[i + j];
+                if (tok.code() == TokenCode::STRING) lex.string_table[tok.value<std::uint32_t>()].offset += by;
+            }
+            i += run.size();
+        }
+    };
+    recount(from_end, begin, text.size + 1);
+    recount(old, from_end, -(text.size + 1));
+    text = { source.data(), (std::uint32_t)(text.size + delta), begin + tokens.size() - range.begin };
+
+    lex.token_pool.splice(begin, old - begin, tokens);
+    lex.offset_pool.splice(begin, old - begin, offsets);
+    std::int64_t moved = (std::int64_t)tokens.size() - (std::int64_t)(old - begin);
+    lex.file_ranges[file].end += moved;
+    for (std::size_t f = file + 1; f < lex.file_ranges.size(); f++) {
+        lex.file_ranges[f].begin += moved;
+        lex.file_ranges[f].end += moved;
+    }
+
+    if (lex.read >= lex.count()) lex.read = lex.count() ? lex.count() - 1 : 0;
+    return { begin, old, begin + tokens.size() };
+}
+
+TokenStream::TokenStream(std::FILE* in): in(in) {
+    buf_capacity = 1 << 12;
+    buf = new char[buf_capacity + SOURCE_PADDING]();
+    cursor = buf;
+}
+
+bool TokenStream::read_more() {
+    // everything before the cursor is lexed, and the ring is empty
+    buf_len -= cursor - buf;
+    std::memmove(buf, cursor, buf_len);
+    cursor = buf;
+
+    // reads by lines, so a pipe's text is lexed as soon as it arrives. reads at
+    // least as much as is already pending, so a long string crossing many
+    // lines isn't re-lexed once per line
+    std::size_t pending = buf_len;
+    bool got = false;
+    do {
+        if (buf_capacity - buf_len < 256) {
+            char* bigger = new char[(buf_capacity <<= 1) + SOURCE_PADDING];
+            std::memcpy(bigger, buf, buf_len);
+            delete[] buf;
+            cursor = buf = bigger;
+        }
+        if (!std::fgets(buf + buf_len, (int)(buf_capacity - buf_len), in)) break;
+        buf_len += std::strlen(buf + buf_len);
+        got = true;
+    } while (buf_len - pending < pending);
+
+    std::memset(buf + buf_len, 0, SOURCE_PADDING);
+    return got;
+}
+
+void TokenStream::fill() {
+    head = tail = 0;
+    // payloads only live as long as the ring
+    lex.string_table.reset();
+    lex.int_table.reset();
+    lex.float_table.reset();
+    if (done) { ring[tail++] = Token(TokenCode::_EOF); return; }
+
+    for (;;) {
+        const char* end = buf + buf_len;
+        const char* stop = Lexer::NO_STOP;
+        if (!eof) {
+            // with more input to come only tokens before the last newline are
+            // complete, nothing but a string runs across one
+            stop = end;
+            while (stop > cursor && stop[-1] != '\n') --stop;
+        }
+
+        // strings are read through file 0, which starts where the input does
+        lex.file_texts.assign(1, { (const char*)((std::uintptr_t)cursor - cursor_offset), 0 });
+        Lexer lexer(lex, cursor, stop, cursor_offset);
+        Token tok;
+        while (tail < TOKEN_RING_SIZE) {
+            const char* at = lexer.position();
+            std::size_t reported = lex.diagnostic_sink.size();
+            if (!lexer.next(tok)) {
+                cursor = lexer.position();
+                cursor_offset = lexer.offset_of(cursor);
+                break;
+            }
+            // a string that hit the end of what's been read, redone after more
+            if (!eof && lexer.position() >= end) {
+                lex.diagnostic_sink.truncate(reported);
+                cursor = at;
+                break;
+            }
+            ring[tail++] = tok;
+            cursor = lexer.position();
+            cursor_offset = lexer.offset_of(cursor);
+        }
+
+        if (tail) return;
+        if (eof) {
+            ring[tail++] = Token(TokenCode::_EOF);
+            done = true;
+            return;
+        }
+        if (!read_more()) eof = true;
+    }
+}
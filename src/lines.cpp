@@ -0,0 +1,37 @@
+#include <lang/lines.hpp>
+
+#include <algorithm>
+#include <lang/scan.hpp>
+#include <lang/trace.hpp>
+
+void LineTable::build() {
+    TRACE_SPAN("line table", (std::int64_t)length);
+    // counted first, so the table is allocated once at its exact size
+    const char* end = text + length;
+    std::size_t count = scan::line_starts(text, end, nullptr);
+    starts.resize(count + 1);
+    starts[0] = 0;
+    scan::line_starts(text, end, starts.data() + 1);
+}
+
+LineColumn LineTable::locate(std::uint32_t offset) {
+    if (starts.empty()) build();
+    if (offset > length) offset = length;
+    // the last start at or before offset
+    std::uint32_t line = (std::uint32_t)(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin());
+    return { line, offset - starts[line - 1] + 1 };
+}
+
+std::size_t LineTable::line_count() {
+    if (starts.empty()) build();
+    return starts.size();
+}
+
+TextView LineTable::line(std::uint32_t line) {
+    if (starts.empty()) build();
+    if (line == 0 || line > starts.size()) return {};
+    std::uint32_t begin = starts[line - 1];
+    std::uint32_t end = line < starts.size() ? starts[line] - 1 : length;
+    if (end > begin && text[end - 1] == '\r') --end;
+    return TextView(text + begin, text + end);
+}
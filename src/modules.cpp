@@ -0,0 +1,180 @@
+#include <lang/modules.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <lang/tasks.hpp>
+#include <lang/trace.hpp>
+
+namespace fs = std::filesystem;
+
+// canonical path of a regular file, empty if there's none
+static std::string existing(const fs::path& path) {
+    std::error_code error;
+    if (!fs::is_regular_file(path, error)) return {};
+    fs::path canonical = fs::weakly_canonical(path, error);
+    return error ? std::string() : canonical.string();
+}
+
+ModuleGraph::ModuleGraph(std::vector<std::string> search_paths, const UnitCache* cache, std::size_t max_depth)
+    : search(std::move(search_paths)), cache(cache), max_depth(max_depth) {}
+
+bool ModuleGraph::intern(const std::string& path, std::uint32_t& index) {
+    std::lock_guard guard(lock);
+    auto found = by_path.find(path);
+    if (found != by_path.end()) {
+        index = found->second;
+        return false;
+    }
+    index = (std::uint32_t)modules.size();
+    modules.emplace()->path = path;
+    by_path.emplace(path, index);
+    return true;
+}
+
+// the pool's blocks don't move, the reference outlives the lock
+Module& ModuleGraph::at(std::uint32_t index) {
+    std::lock_guard guard(lock);
+    return modules[index];
+}
+
+bool ModuleGraph::add_root(const char* path) {
+    std::string canonical = existing(path);
+    if (canonical.empty()) return false;
+    std::uint32_t index;
+    intern(canonical, index);
+    if (std::find(roots.begin(), roots.end(), index) == roots.end()) roots.push_back(index);
+    return true;
+}
+
+// the file a GET node names, empty (and reported) if there's none
+std::string ModuleGraph::resolve(Module& importer, const Node& get) {
+    const LexOutput& lex = importer.unit.lex;
+    const Ast& ast = importer.unit.ast;
+    Diagnostics& diagnostics = importer.unit.lex.diagnostics();
+    std::uint32_t offset = lex.offset(get.token);
+
+    std::string name;
+    const Node& target = ast[get.a];
+    if (target.kind == NodeKind::ERROR) return {}; // the parser said why
+    if (target.kind == NodeKind::LITERAL && lex.tokens()[target.token].code() == TokenCode::STRING) {
+        TextView text = lex.string(lex.tokens()[target.token].value<std::uint32_t>());
+        name.assign(text.data(), text.size());
+    } else {
+        // a.b.c is MEMBER(MEMBER(a, b), c), the parts come out last first
+        std::vector<TextView> parts;
+        std::uint32_t at = get.a;
+        for (; ast[at].kind == NodeKind::MEMBER && ast[at].b != NO_NODE; at = ast[at].a) {
+            parts.push_back(lex.symbols().name(lex.tokens()[ast[ast[at].b].token].value<std::uint32_t>()));
+        }
+        if (ast[at].kind != NodeKind::NAME) {
+            diagnostics.report(DiagCode::BAD_MODULE, 0, offset);
+            return {};
+        }
+        parts.push_back(lex.symbols().name(lex.tokens()[ast[at].token].value<std::uint32_t>()));
+        for (auto part = parts.rbegin(); part != parts.rend(); ++part) {
+            if (!name.empty()) name += '/';
+            name.append(part->data(), part->size());
+        }
+        name += MODULE_EXTENSION;
+    }
+
+    fs::path relative(name);
+    if (!name.empty() && relative.is_absolute()) {
+        std::string found = existing(relative);
+        if (!found.empty()) return found;
+    } else if (!name.empty()) {
+        std::string found = existing(fs::path(importer.path).parent_path() / relative);
+        for (std::size_t i = 0; found.empty() && i < search.size(); i++) found = existing(fs::path(search[i]) / relative);
+        if (!found.empty()) return found;
+    }
+    diagnostics.report(DiagCode::MODULE_NOT_FOUND, 0, offset);
+    return {};
+}
+
+void ModuleGraph::compile_module(std::uint32_t index, TaskPool& tasks) {
+    TRACE_SPAN("compile module", (std::int64_t)index);
+    Module& module = at(index);
+    module.source = SourceBuffer::load(module.path.c_str());
+    if (!module.source) return; // its importers report it
+
+    if (cache && cache->load(module.source, module.unit)) {
+        module.cached = true;
+        ++ cache_hits;
+    } else {
+        compile(module.unit, module.source, max_depth);
+        if (cache) cache->store(module.source, module.unit);
+    }
+
+    // the tree is post-order, gets come out in source order
+    const Ast& ast = module.unit.ast;
+    for (std::uint32_t i = 0; i < ast.size(); i++) {
+        if (ast[i].kind != NodeKind::GET) continue;
+        std::string path = resolve(module, ast[i]);
+        if (path.empty()) continue;
+        std::uint32_t target;
+        if (intern(path, target)) tasks.spawn(target);
+        module.imports.push_back({ target, i });
+    }
+}
+
+void ModuleGraph::build(int jobs) {
+    TRACE_SPAN("build modules");
+    TaskPool tasks(jobs);
+    for (std::uint32_t root : roots) tasks.spawn(root);
+    tasks.run([&](std::uint32_t index) { compile_module(index, tasks); });
+}
+
+std::vector<std::uint32_t> ModuleGraph::order() {
+    enum : std::uint8_t { NEW, OPEN, DONE };
+    std::vector<std::uint8_t> state(modules.size(), NEW);
+    std::vector<std::uint32_t> depth(modules.size()); // where an open module is on the stack
+    std::vector<std::uint32_t> sequence;
+
+    // depth first, a module goes out once all it gets did
+    struct Frame { std::uint32_t module, next; };
+    std::vector<Frame> stack;
+    for (std::uint32_t root : roots) {
+        if (state[root] != NEW || !modules[root].source) continue;
+        state[root] = OPEN;
+        stack.push_back({ root, 0 });
+        while (!stack.empty()) {
+            Frame& top = stack.back();
+            Module& module = modules[top.module];
+            if (top.next == module.imports.size()) {
+                state[top.module] = DONE;
+                sequence.push_back(top.module);
+                stack.pop_back();
+                continue;
+            }
+
+            Import import = module.imports[top.next++];
+            std::uint32_t offset = module.unit.lex.offset(module.unit.ast[import.node].token);
+            if (!modules[import.module].source) {
+                module.unit.lex.diagnostics().report(DiagCode::UNREADABLE_MODULE, 0, offset);
+            } else if (state[import.module] == OPEN) {
+                std::uint32_t length = (std::uint32_t)stack.size() - depth[import.module];
+                module.unit.lex.diagnostics().report(DiagCode::IMPORT_CYCLE, 0, offset, length);
+            } else if (state[import.module] == NEW) {
+                state[import.module] = OPEN;
+                depth[import.module] = (std::uint32_t)stack.size();
+                stack.push_back({ import.module, 0 });
+            }
+        }
+    }
+    return sequence;
+}
+
+void ModuleGraph::link(Unit& program, std::vector<SourceBuffer>& sources, std::vector<std::string>& paths) {
+    TRACE_SPAN("link modules");
+    for (std::uint32_t index : order()) {
+        Module& module = modules[index];
+        // the unit's first token lands where our _EOF is
+        std::uint32_t token_base = program.lex.count() ? (std::uint32_t)program.lex.count() - 1 : 0;
+        program.lex.append(module.unit.lex);
+        program.ast.append(module.unit.ast, token_base);
+        sources.push_back(std::move(module.source));
+        paths.push_back(module.path);
+        module.unit.lex.reset();
+        module.unit.ast.reset();
+    }
+}
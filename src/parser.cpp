@@ -1,316 +1,647 @@
-/*
+#include <lang/parser.hpp>
 
-#include "../include/parser.hpp"
-#include "dlex.hpp"
+#include <array>
+#include <string>
 
-std::string binary_op_to_string(BinaryExprPayload op) {
-    using enum BinaryExprPayload;
-    switch (op) {
-        case _add:    return "add";
-        case _sub:    return "subtract";
-        case _div:    return "divide";
-        case _mul:    return "multiply";
-        case _mod:    return "modulo";
-        case _pow:    return "power";
-        case _log:    return "logarithm";
-        case _concat: return "concatenate";
-        case _and:    return "and";
-        case _or:     return "or";
-        case _xor:    return "xor";
-        case _rsh:    return "right shift";
-        case _lsh:    return "left shift";
-        case _neq:    return "not equal";
-        case _eq:     return "equal";
-        case _lt:     return "less than";
-        case _gt:     return "greater than";
-        case _lteq:   return "less than or equal";
-        case _gteq:   return "greater than or equal";
-        case _if:     return "if";
-        case _else:   return "else";
-        case _func:   return "function";
-        case _idx:    return "index";
-        case _bin_error: return "ERROR";
-        default: return "UNKNOWN";
+const char* node_name(NodeKind kind) noexcept {
+    switch (kind) {
+#define NODE(kind, name) case NodeKind::kind: return name;
+        DOYT_NODES(NODE)
+#undef NODE
     }
+    return "?";
 }
 
-std::string literal_type_to_string(LiteralExprPayload type) {
-    switch (type) {
-        case LiteralExprPayload::_litfloat: return "float literal";
-        case LiteralExprPayload::_litbool:  return "boolean literal";
-        case LiteralExprPayload::_litstr:   return "string literal";
-        case LiteralExprPayload::_error:    return "ERROR";
-        default: return "UNKNOWN";
+bool Node::is_list() const noexcept {
+    using enum NodeKind;
+    switch (kind) {
+        case CALL: case ARRAY: case SEQ: case BLOCK: case IF: case FOR: case FUNC: case SOURCE: case PROGRAM:
+            return true;
+        default:
+            return false;
     }
 }
 
-std::string unary_op_to_string(UnaryExprPayload op) {
+const char* op_text(Op op) noexcept {
     switch (op) {
-        case UnaryExprPayload::_neg:  return "negate";
-        case UnaryExprPayload::_not:  return "not";
-        case UnaryExprPayload::_exp:  return "exponential";
-        case UnaryExprPayload::_ln:   return "natural log";
-        case UnaryExprPayload::_abs:  return "absolute value";
-        case UnaryExprPayload::_flr:  return "floor";
-        case UnaryExprPayload::_sqrt: return "square root";
-        case UnaryExprPayload::_unary_error: return "ERROR";
-        default: return "UNKNOWN";
+#define OP(op, text) case Op::op: return text;
+        DOYT_OPS(OP)
+#undef OP
     }
+    return "?";
 }
 
-std::string variant_to_string(const dTPayload& payload) {
-    return std::visit([](auto&& arg) -> std::string {
-        using T = std::decay_t<decltype(arg)>;
-        if constexpr (std::is_same_v<T, std::string>) {
-            return arg;
-        } else if constexpr (std::is_same_v<T, float>) {
-            return std::to_string(arg);
-        } else if constexpr (std::is_same_v<T, bool>) {
-            return arg ? "true" : "false";
-        }
-        return "";  // fallback
-    }, payload);
+static void print_line(std::ostream& stream, const Ast& ast, const LexOutput& lex, std::uint32_t index, std::size_t depth) {
+    stream << std::string(depth * 2, ' ');
+    if (index == NO_NODE) { stream << "-\n"; return; }
+
+    const Node& node = ast[index];
+    stream << node_name(node.kind);
+    switch (node.kind) {
+        case NodeKind::LITERAL: stream << " "; lex.tokens()[node.token].print(stream, lex); break;
+        case NodeKind::NAME: stream << " " << lex.symbols().name(lex.tokens()[node.token].value<std::uint32_t>()); break;
+        case NodeKind::UNARY: case NodeKind::BINARY: stream << " " << op_text(node.op); break;
+        default: break;
+    }
+    stream << "\n";
 }
 
-std::string AST_to_str(Expr* root, int indent) {
-    std::string ret = std::string(indent, '\t');
-    
-    switch (root->kind) {
-        case ExprType::Literal: {
-            LiteralExpr* root_casted = (LiteralExpr*)root;
-            ret.append(literal_type_to_string(root_casted->type) + ": ");
-            ret.append(variant_to_string( ((LiteralExpr*)root)->value ));
-            break;
-        }
-        case ExprType::Unary: {
-            UnaryExpr* root_casted = (UnaryExpr*)root;
-            ret.append(unary_op_to_string(root_casted->op) + ": \n");
-            ret.append(AST_to_str( root_casted->operand, indent + 1 ));
-            break;;
+// pre-order with a stack of its own, as deep as the parser let the tree get
+std::ostream& Ast::print(std::ostream& stream, const LexOutput& lex) const {
+    if (root_node == NO_NODE) return stream;
+    struct Item { std::uint32_t index; std::size_t depth; };
+    std::vector<Item> stack{ { root_node, 0 } };
+
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+        print_line(stream, *this, lex, item.index, item.depth);
+        if (item.index == NO_NODE) continue;
+
+        // children go on in reverse, so they come off in order
+        const Node& node = node_pool[item.index];
+        if (node.is_list()) {
+            for (std::uint32_t i = node.b; i--;) stack.push_back({ list_pool[node.a + i], item.depth + 1 });
+            continue;
         }
-        case ExprType::Binary: {
-            BinaryExpr* root_casted = (BinaryExpr*)root;
-            ret.append(binary_op_to_string(root_casted->op) + ": \n");
-            ret.append(AST_to_str( root_casted->left , indent + 1 ));
-            ret.append(AST_to_str( root_casted->right, indent + 1 ));
-            break;
-        }
-        case ExprType::Identifier: {
-            IdentifierExpr* root_casted = (IdentifierExpr*)root;
-            ret.append("ident: " + root_casted->name);
-            break;
-        }
-        case ExprType::Call: {
-            CallExpr* root_casted = (CallExpr*)root;
-            ret.append("call:\n");
-            ret.append(std::string(indent + 1, '\t') + "fn:\n");
-            ret.append(AST_to_str(root_casted->fn, indent + 2));
-            for (size_t i = 0; i < root_casted->args.size(); i++) {
-                ret.append(std::string(indent + 1, '\t') + "arg" + std::to_string(i) + ":\n");
-                ret.append(AST_to_str(root_casted->args[i], indent + 2));
-            }
-            break;
+        switch (node.kind) {
+            case NodeKind::ERROR: case NodeKind::LITERAL: case NodeKind::NAME: case NodeKind::BREAK: case NodeKind::CONTINUE:
+                break;
+            case NodeKind::UNARY: case NodeKind::RET: case NodeKind::GET:
+                stack.push_back({ node.a, item.depth + 1 });
+                break;
+            default:
+                stack.push_back({ node.b, item.depth + 1 });
+                stack.push_back({ node.a, item.depth + 1 });
         }
     }
-    return ret;
+    return stream;
 }
 
+void Ast::append(const Ast& unit, std::uint32_t token_base) {
+    std::size_t mark = 0;
+    std::vector<std::uint32_t> sources;
+    if (root_node != NO_NODE) {
+        // our PROGRAM and its list are last, they're made again below
+        const Node& program = node_pool[root_node];
+        mark = program.a;
+        for (std::uint32_t i = 0; i < program.b; i++) sources.push_back(list_pool[program.a + i]);
+        node_pool.pop_back();
+        while (list_pool.size() > mark) list_pool.pop_back();
+    }
 
-BinaryExprPayload get_bin_op_payload(Token& op) {
-    switch (op.type) {
-        case dTCode::plusT:  return BinaryExprPayload::_add;
-        case dTCode::minusT: return BinaryExprPayload::_sub;
-        case dTCode::starT:  return BinaryExprPayload::_mul;
-        case dTCode::slashT: return BinaryExprPayload::_div;
-        default: throw parser_error("Tried to get the operator payload type of sth thats not an operator");
+    // everything but the unit's PROGRAM, with indices moved past ours
+    const Node& unit_program = unit.node_pool[unit.root_node];
+    std::uint32_t node_base = (std::uint32_t)node_pool.size(), list_base = (std::uint32_t)list_pool.size();
+    auto move = [&](std::uint32_t index) { return index == NO_NODE ? NO_NODE : index + node_base; };
+    for (std::uint32_t i = 0; i < unit_program.a; i++) list_pool.insert(move(unit.list_pool[i]));
+    for (std::uint32_t i = 0; i < unit.root_node; i++) {
+        Node node = unit.node_pool[i];
+        node.token += token_base;
+        if (node.is_list()) node.a += list_base;
+        else { node.a = move(node.a); node.b = move(node.b); }
+        node_pool.insert(node);
     }
+    for (std::uint32_t i = 0; i < unit_program.b; i++) sources.push_back(move(unit.list_pool[unit_program.a + i]));
+
+    std::uint32_t first = (std::uint32_t)list_pool.size();
+    for (std::uint32_t source : sources) list_pool.insert(source);
+    node_pool.insert(Node{ NodeKind::PROGRAM, Op::NONE, 0, first, (std::uint32_t)sources.size() });
+    root_node = (std::uint32_t)node_pool.size() - 1;
 }
 
-LiteralExprPayload get_literal_payload(Token& literal) {
-    switch (literal.type) {
-        case dTCode::numT: return LiteralExprPayload::_litfloat;
-        case dTCode::boolT: return LiteralExprPayload::_litbool;
-        case dTCode::strT: return LiteralExprPayload::_litstr;
-        default: throw parser_error("Tried to get literal payload type of sth thats not a literal");
-    }
+// what a token does at the start of an expression (nud)
+enum class Prefix : std::uint8_t { NONE, LITERAL, NAME, UNARY, GROUP, ARRAY };
+// and after one (led)
+enum class Infix : std::uint8_t { NONE, BINARY, ASSIGN, MEMBER, INDEX, CALL };
+
+// left < right binds left to right, left > right right to left (assignment),
+// a left of 0 ends the expression
+struct Rule {
+    Prefix prefix = Prefix::NONE;
+    Infix infix = Infix::NONE;
+    std::uint8_t left = 0, right = 0;
+    Op prefix_op = Op::NONE, infix_op = Op::NONE;
+};
+
+#define BP_PREFIX 13
+
+// one entry per TokenCode, so dispatching on a token is a single load
+constexpr auto make_rules() {
+    using enum TokenCode;
+    std::array<Rule, (std::size_t)_COUNT> rules{};
+    auto prefix = [&](TokenCode code, Prefix handler, Op op = Op::NONE) {
+        rules[(std::size_t)code].prefix = handler;
+        rules[(std::size_t)code].prefix_op = op;
+    };
+    auto infix = [&](TokenCode code, Infix handler, std::uint8_t left, std::uint8_t right, Op op = Op::NONE) {
+        Rule& rule = rules[(std::size_t)code];
+        rule.infix = handler;
+        rule.left = left;
+        rule.right = right;
+        rule.infix_op = op;
+    };
+
+    for (TokenCode code : { INT, FLOAT, STRING, CHAR, BOOL, NIL }) prefix(code, Prefix::LITERAL);
+    prefix(IDENTITY, Prefix::NAME);
+    prefix(MINUS, Prefix::UNARY, Op::NEG);
+    prefix(EXC, Prefix::UNARY, Op::NOT);
+    prefix(PARAN_L, Prefix::GROUP);
+    prefix(BRACK_L, Prefix::ARRAY);
+
+    infix(EQ, Infix::ASSIGN, 2, 1);
+    infix(EQ2, Infix::BINARY, 3, 4, Op::EQ);
+    infix(NEQ, Infix::BINARY, 3, 4, Op::NEQ);
+    infix(LT, Infix::BINARY, 5, 6, Op::LT);
+    infix(GT, Infix::BINARY, 5, 6, Op::GT);
+    infix(LTEQ, Infix::BINARY, 5, 6, Op::LTEQ);
+    infix(GTEQ, Infix::BINARY, 5, 6, Op::GTEQ);
+    infix(LT2, Infix::BINARY, 7, 8, Op::SHL);
+    infix(GT2, Infix::BINARY, 7, 8, Op::SHR);
+    infix(PLUS, Infix::BINARY, 9, 10, Op::ADD);
+    infix(MINUS, Infix::BINARY, 9, 10, Op::SUB);
+    infix(STAR, Infix::BINARY, 11, 12, Op::MUL);
+    infix(SLASH, Infix::BINARY, 11, 12, Op::DIV);
+    infix(PARAN_L, Infix::CALL, 15, 16);
+    infix(BRACK_L, Infix::INDEX, 15, 16);
+    infix(DOT, Infix::MEMBER, 15, 16);
+    return rules;
 }
 
+constexpr auto rules = make_rules();
+static_assert(rules[(std::size_t)TokenCode::STAR].left > rules[(std::size_t)TokenCode::PLUS].left);
+static_assert(BP_PREFIX > rules[(std::size_t)TokenCode::STAR].right && BP_PREFIX < rules[(std::size_t)TokenCode::PARAN_L].left);
 
-#define BP_ADD_SUB ((std::pair<float,float>){1.0, 1.1})
-#define BP_MUL_DIV ((std::pair<float,float>){2.0, 2.1})
-#define BP_IDX ((std::pair<float,float>){10.0, 10.1})
-#define BP_FN_CALL ((std::pair<float,float>) {6.0, 6.1})
-#define BP_NEG (5)
-// parse_expression should probably handle garbage tokens
-std::pair<float,float> binding_power(Token& op) {
-    switch(op.type) {
-        case dTCode::plusT:
-        case dTCode::minusT: return BP_ADD_SUB;
-        case dTCode::starT:
-        case dTCode::slashT: return BP_MUL_DIV;
-        default: return {0.0,0.0};
+inline const Rule& rule_of(TokenCode code) { return rules[(unsigned char)code]; }
+
+// a TokenCode as a diagnostic argument
+static std::uint32_t code_arg(TokenCode code) { return (unsigned char)code; }
+
+static bool starts_statement(TokenCode code) {
+    using enum TokenCode;
+    switch (code) {
+        case FUNC: case IF: case WHILE: case FOR: case RET: case BREAK: case CONTINUE: case GET:
+            return true;
+        default:
+            return false;
     }
 }
 
-
-bool is_literal(dTCode code) {
-    return  code == dTCode::identT ||
-            code == dTCode::numT ||
-            code == dTCode::strT ||
-            code == dTCode::charT ||
-            code == dTCode::boolT ||
-            code == dTCode::nullT;
+void Parser::error(DiagCode code, std::uint32_t token, std::uint32_t arg0, std::uint32_t arg1) {
+    // one report per error, until we resync the rest is mostly its echo
+    if (!panic) diags.report(code, file, lex.offset(token), arg0, arg1);
+    panic = true;
 }
 
+bool Parser::expect(TokenCode code, DiagCode diag, TokenCode after) {
+    if (accept(code)) return true;
+    TokenCode found = peek().code();
+    if (after == TokenCode::_EOF) error(diag, here(), code_arg(found));
+    else error(diag, here(), code_arg(after), code_arg(found));
+    return false;
+}
 
+void Parser::synchronize(std::uint32_t from) {
+    panic = false;
+    TokenCode next = peek().code();
+    if (position() == from && next != TokenCode::_EOF && next != TokenCode::CURLY_R) consume();
+    for (;;) {
+        TokenCode code = peek().code();
+        if (code == TokenCode::_EOF || code == TokenCode::CURLY_R || starts_statement(code)) return;
+        if (last >= file_first && position() != file_first) {
+            TokenCode prev = lex.tokens()[last].code();
+            if (prev == TokenCode::SEMI || prev == TokenCode::CURLY_R) return;
+        }
+        consume();
+    }
+}
 
+std::uint32_t Parser::node(NodeKind kind, std::uint32_t token, std::uint32_t a, std::uint32_t b, Op op) {
+    ast.node_pool.insert(Node{ kind, op, token, a, b });
+    return (std::uint32_t)ast.node_pool.size() - 1;
+}
 
-// Expr* parse_line(LexOutput lex) {
-    
-// }
+std::uint32_t Parser::list(NodeKind kind, std::uint32_t token, std::size_t mark) {
+    std::uint32_t first = (std::uint32_t)ast.list_pool.size();
+    for (std::size_t i = mark; i < scratch.size(); i++) ast.list_pool.insert(scratch[i]);
+    std::uint32_t count = (std::uint32_t)(scratch.size() - mark);
+    scratch.resize(mark);
+    return node(kind, token, first, count);
+}
 
-Expr* Parser::nud(Token op) {
-    if ( is_literal(op.type) ) {
-        LiteralExpr* ret = alloc_expr<LiteralExpr>(); 
-        ret->type = get_literal_payload(op);
-        ret->value = op.pl;
-        return ret;
+void Parser::parse_items(TokenCode close, DiagCode diag, TokenCode after) {
+    if (accept(close)) return;
+    for (;;) {
+        scratch.push_back(parse_expression());
+        if (!accept(TokenCode::COMMA)) break;
+        if (accept(close)) return; // trailing comma
     }
+    expect(close, diag, after);
+}
+
+std::uint32_t Parser::missing_operand() {
+    // left where it is, it may well be the ';' or '}' we resync at
+    error(DiagCode::EXPECTED_EXPRESSION, here(), code_arg(peek().code()));
+    return node(NodeKind::ERROR, here());
+}
 
-    switch (op.type) {
-        case dTCode::minusT: {
-            UnaryExpr* ret = alloc_expr<UnaryExpr>();
-            ret->op = UnaryExprPayload::_neg;
-            ret->operand = parse_expression(BP_NEG); // very high binding power since minus needs to bind very tightly
+// inline, or its error path gets it out of the pratt loop, which costs a call per operand
+inline bool Parser::nud(std::uint32_t& value) {
+    const Rule& rule = rule_of(peek().code());
+    if (rule.prefix == Prefix::NONE) [[unlikely]] {
+        value = missing_operand();
+        return true;
+    }
+    skip(); // has a prefix, so it isn't the eof
+    std::uint32_t at = last;
+
+    switch (rule.prefix) {
+        case Prefix::LITERAL:
+            value = node(NodeKind::LITERAL, at);
+            return true;
+
+        case Prefix::NAME:
+            value = node(NodeKind::NAME, at);
+            return true;
+
+        case Prefix::UNARY:
+            push({ Pending::UNARY, BP_PREFIX, rule.prefix_op, at });
+            return false;
+
+        case Prefix::GROUP:
+            push({ Pending::GROUP, 0, Op::NONE, at });
+            return false;
+
+        default: // ARRAY
+            if (accept(TokenCode::BRACK_R)) {
+                value = list(NodeKind::ARRAY, at, scratch.size());
+                return true;
+            }
+            push({ Pending::ARRAY, 0, Op::NONE, at, NO_NODE, (std::uint32_t)scratch.size() });
+            return false;
+    }
+}
 
-            return ret;
+bool Parser::led(const Token& op, std::uint32_t& value) {
+    std::uint32_t at = last;
+    const Rule& rule = rule_of(op.code());
+    switch (rule.infix) {
+        case Infix::BINARY: {
+            // most right operands are a name or literal that nothing binds to,
+            // the node is made right away without a frame
+            Prefix leaf = rule_of(peek().code()).prefix;
+            if (leaf != Prefix::NAME && leaf != Prefix::LITERAL) {
+                if (!push({ Pending::BINARY, rule.right, rule.infix_op, at, value })) return false;
+                return nud(value);
+            }
+            skip();
+            std::uint32_t right = node(leaf == Prefix::NAME ? NodeKind::NAME : NodeKind::LITERAL, last);
+            if (rule_of(peek().code()).left <= rule.right) {
+                value = node(NodeKind::BINARY, at, value, right, rule.infix_op);
+                return true;
+            }
+            if (!push({ Pending::BINARY, rule.right, rule.infix_op, at, value })) return false;
+            value = right;
+            return true;
         }
 
-        case dTCode::lparT: {
-            Expr* right = parse_expression(0);
-            Token expected_rparen = lex.consume();
-            if (expected_rparen.type != dTCode::rparT) {
-                throw  parser_error("Expected ')' to close '('") ;
+        case Infix::ASSIGN: {
+            // reported, but the tree is fine as it is, nothing to resync
+            NodeKind target = ast[value].kind;
+            if (target != NodeKind::NAME && target != NodeKind::INDEX && target != NodeKind::MEMBER
+                && target != NodeKind::ERROR && !panic) {
+                diags.report(DiagCode::BAD_ASSIGN, file, lex.offset(at));
             }
-            return right;
+            push({ Pending::ASSIGN, rule.right, Op::NONE, at, value });
+            return false;
         }
 
-        case dTCode::identT: { // stuff like `x` and `math`
-            IdentifierExpr* ident = alloc_expr<IdentifierExpr>();
-            ident->name = std::get<std::string>(op.pl);
+        case Infix::MEMBER:
+            if (!expect(TokenCode::IDENTITY, DiagCode::EXPECTED_MEMBER)) {
+                value = node(NodeKind::MEMBER, at, value, NO_NODE);
+                return true;
+            }
+            value = node(NodeKind::MEMBER, at, value, node(NodeKind::NAME, last));
+            return true;
+
+        case Infix::INDEX:
+            push({ Pending::INDEX, 0, Op::NONE, at, value });
+            return false;
+
+        case Infix::CALL: {
+            std::uint32_t mark = (std::uint32_t)scratch.size();
+            scratch.push_back(value);
+            if (accept(TokenCode::PARAN_R)) {
+                value = list(NodeKind::CALL, at, mark);
+                return true;
+            }
+            push({ Pending::CALL, 0, Op::NONE, at, NO_NODE, mark });
+            return false;
         }
 
-        default:
-            throw parser_error("unexpected token seen");
-                
+        default: // no token has a left binding power without an infix rule
+            return true;
     }
 }
 
-Expr* Parser::led(Token op, Expr* left) {
-    switch (op.type) {
-        case dTCode::plusT:
-        case dTCode::minusT:
-        case dTCode::starT:
-        case dTCode::slashT: {
-            Expr* right = parse_expression(binding_power(op).second);
-            BinaryExpr* expr = alloc_expr<BinaryExpr>();
-            expr->left = left;
-            expr->right = right;
-            expr->op = get_bin_op_payload(op);
-
-            return expr;
-        }
-        case dTCode::dot: {
-            if (left->kind != ExprType::Identifier) {
-                throw parser_error("Expected identifier before '.'");
-            }
-            Expr* right = parse_expression(BP_IDX.second);
-            BinaryExpr* expr = alloc_expr<BinaryExpr>();
-            expr->left = left;
-            expr->right = right;
-            expr->op = BinaryExprPayload::_idx;
-            return expr;
-        }
-        case dTCode::lparT: {
-            std::vector<Expr*> args;
-
-            if (lex.peek().type != dTCode::rparT) { // not empty call
-                while (true) {
-                    args.push_back(parse_expression(0));
-
-                    Token next = lex.peek();
-                    if (next.type == dTCode::comma) {
-                        lex.consume();
-                        continue;
-                    }
-                    break;
-                }
-            }
+bool Parser::reduce(std::uint32_t& value) {
+    const Frame& frame = *top;
+    switch (frame.pending) {
+        case Pending::UNARY:
+            value = node(NodeKind::UNARY, frame.token, value, NO_NODE, frame.op);
+            break;
 
-            Token expected_rparen = lex.consume();
-            if (expected_rparen.type != dTCode::rparT) {
-                throw parser_error("expected ')' to close func call");
-            }
+        case Pending::BINARY:
+            value = node(NodeKind::BINARY, frame.token, frame.left, value, frame.op);
+            break;
+
+        case Pending::ASSIGN:
+            value = node(NodeKind::ASSIGN, frame.token, frame.left, value);
+            break;
+
+        case Pending::GROUP:
+            expect(TokenCode::PARAN_R, DiagCode::UNCLOSED_GROUP);
+            break;
 
-            CallExpr* expr = alloc_expr<CallExpr>();
-            expr->fn = (IdentifierExpr*) left;
-            expr->args = args;
-            return expr;
+        case Pending::INDEX:
+            expect(TokenCode::BRACK_R, DiagCode::UNCLOSED_INDEX);
+            value = node(NodeKind::INDEX, frame.token, frame.left, value);
+            break;
+
+        default: { // CALL, ARRAY, the frame stays for every item but the last
+            bool call = frame.pending == Pending::CALL;
+            TokenCode close = call ? TokenCode::PARAN_R : TokenCode::BRACK_R;
+            scratch.push_back(value);
+            if (accept(TokenCode::COMMA)) {
+                if (!accept(close)) return false; // trailing comma otherwise
+            } else {
+                expect(close, call ? DiagCode::UNCLOSED_CALL : DiagCode::UNCLOSED_ARRAY);
+            }
+            value = list(call ? NodeKind::CALL : NodeKind::ARRAY, frame.token, frame.mark);
         }
+    }
+    -- top;
+    return true;
+}
 
-        default:
-            throw parser_error("Unexpected token found during parsing");
+bool Parser::grow() {
+    std::size_t used = frames.empty() ? 0 : top - frames.data() + 1;
+    if (used > max_depth) {
+        overflow = true;
+        return false;
     }
+    std::size_t size = frames.size() ? frames.size() * 2 : 64;
+    if (size > max_depth + 1) size = max_depth + 1; // the DONE frame and max_depth more
+    frames.resize(size);
+    top = frames.data() + (used ? used - 1 : 0);
+    frames_end = frames.data() + frames.size();
+    return true;
 }
 
-template <typename T> struct ExprTypeTraits;
-template <> struct ExprTypeTraits<BinaryExpr>     { static constexpr ExprType value = ExprType::Binary; };
-template <> struct ExprTypeTraits<UnaryExpr>      { static constexpr ExprType value = ExprType::Unary; };
-template <> struct ExprTypeTraits<LiteralExpr>    { static constexpr ExprType value = ExprType::Literal; };
-template <> struct ExprTypeTraits<IdentifierExpr> { static constexpr ExprType value = ExprType::Identifier; };
-template <> struct ExprTypeTraits<CallExpr>       { static constexpr ExprType value = ExprType::Call; };
+std::uint32_t Parser::abandon(std::size_t mark) {
+    overflow = false;
+    std::uint32_t at = position();
+    error(DiagCode::TOO_DEEP_EXPRESSION, at, (std::uint32_t)max_depth);
+    // up to where the statement ends, brackets opened on the way are skipped whole
+    for (std::size_t depth = 0;;) {
+        TokenCode code = peek().code();
+        if (code == TokenCode::_EOF) break;
+        if (!depth && (code == TokenCode::SEMI || code == TokenCode::CURLY_R)) break;
+        if (code == TokenCode::PARAN_L || code == TokenCode::BRACK_L || code == TokenCode::CURLY_L) depth++;
+        else if ((code == TokenCode::PARAN_R || code == TokenCode::BRACK_R || code == TokenCode::CURLY_R) && depth) depth--;
+        consume();
+    }
+    scratch.resize(mark);
+    return node(NodeKind::ERROR, at);
+}
+
+// the pratt loop, with the recursion of nud and led turned into frames.
+// an operand is read (pushing prefix operators and openers until one shows
+// up), then extended by whatever binds tighter than the frame it's for.
+// once nothing does, it completes that frame and becomes the next operand
+std::uint32_t Parser::parse_expression(int min_bp) {
+    if (frames.empty()) grow();
+    top = frames.data();
+    *top = { Pending::DONE, (std::uint8_t)min_bp };
+    std::size_t mark = scratch.size();
+    std::uint32_t value = NO_NODE;
+
+    for (;;) {
+        if (!nud(value)) {
+            if (overflow) return abandon(mark);
+            continue;
+        }
+
+        for (;;) {
+            const Token& cur = peek();
+            if (rule_of(cur.code()).left > top->min_bp) {
+                skip();
+                if (led(cur, value)) continue;
+                if (overflow) return abandon(mark);
+                break;
+            }
 
+            if (top->pending == Pending::DONE) return value;
+            if (!reduce(value)) break;
+        }
+    }
+}
 
-template <DerivedFromExpr T>
-T* Parser::alloc_expr() {
-    T* expr = (T*) arena.alloc(sizeof(T), alignof(T));
-    expr->kind = ExprTypeTraits<T>::value;
-    return expr;
+std::uint32_t Parser::parse_block() {
+    if (!expect(TokenCode::CURLY_L, DiagCode::EXPECTED_BLOCK)) return node(NodeKind::ERROR, position());
+    std::uint32_t at = last;
+    std::size_t mark = scratch.size();
+    while (peek().code() != TokenCode::CURLY_R && peek().code() != TokenCode::_EOF) {
+        std::uint32_t from = position();
+        scratch.push_back(parse_statement());
+        if (panic) synchronize(from);
+    }
+    expect(TokenCode::CURLY_R, DiagCode::UNCLOSED_BLOCK);
+    return list(NodeKind::BLOCK, at, mark);
 }
 
-Expr* Parser::parse_expression(float min_bp) {
-    Expr* left = nud(lex.consume());
-    
-    while (1) {
-        Token cur = lex.peek();
-        if (!cur.valid() || (binding_power(cur).first <= min_bp))
+// func (type) name (type param, ...) { ... }, the return type is optional.
+// what's missing is left out (NO_NODE), the body is still parsed
+std::uint32_t Parser::parse_func() {
+    consume();
+    std::uint32_t at = last;
+    std::size_t mark = scratch.size();
+
+    if (accept(TokenCode::PARAN_L)) {
+        scratch.push_back(expect(TokenCode::IDENTITY, DiagCode::EXPECTED_RETURN_TYPE) ? node(NodeKind::NAME, last) : NO_NODE);
+        expect(TokenCode::PARAN_R, DiagCode::UNCLOSED_RETURN_TYPE);
+    } else {
+        scratch.push_back(NO_NODE);
+    }
+    scratch.push_back(expect(TokenCode::IDENTITY, DiagCode::EXPECTED_FUNC_NAME) ? node(NodeKind::NAME, last) : NO_NODE);
+
+    if (expect(TokenCode::PARAN_L, DiagCode::EXPECTED_PARAMS) && !accept(TokenCode::PARAN_R)) {
+        for (;;) {
+            if (!expect(TokenCode::IDENTITY, DiagCode::EXPECTED_PARAM)) break;
+            std::uint32_t first = node(NodeKind::NAME, last);
+            if (accept(TokenCode::IDENTITY)) {
+                scratch.push_back(node(NodeKind::PARAM, ast[first].token, first, node(NodeKind::NAME, last)));
+            } else {
+                scratch.push_back(node(NodeKind::PARAM, ast[first].token, NO_NODE, first));
+            }
+            if (accept(TokenCode::COMMA)) continue;
+            expect(TokenCode::PARAN_R, DiagCode::UNCLOSED_PARAMS);
             break;
-        lex.consume();
-        Expr* left = led(cur, left);
+        }
+    }
+    if (panic) {
+        // resync at the body, so its errors are reported too
+        for (TokenCode code = peek().code(); code != TokenCode::CURLY_L; code = peek().code()) {
+            if (code == TokenCode::_EOF || code == TokenCode::CURLY_R || code == TokenCode::SEMI) break;
+            consume();
+        }
+        if (peek().code() == TokenCode::CURLY_L) panic = false;
     }
 
-    return left;
+    scratch.push_back(parse_block());
+    return list(NodeKind::FUNC, at, mark);
 }
 
-Expr* Parser::parse_statement() {
-    Token first_tok = lex.consume();
-    if (first_tok.type == dTCode::identT) { // variable assignemnt? (starts with type possibly)
-        std::string name = std::get<std::string>(first_tok.pl);
-        if (type_registry.contains(name)) {
-            Type t = type_registry.at(name);
+std::uint32_t Parser::parse_statement() {
+    using enum TokenCode;
+    // blocks and bodies recurse, nesting is bounded like expressions are
+    struct Nest {
+        std::size_t& depth;
+        ~Nest() { -- depth; }
+    } nest{ ++ nesting };
+    if (nesting > max_depth) {
+        // the rest of the enclosing block, its '}' is left to close it
+        std::uint32_t at = position();
+        error(DiagCode::TOO_DEEP_STATEMENT, at, (std::uint32_t)max_depth);
+        for (std::size_t depth = 0; peek().code() != _EOF; consume()) {
+            if (peek().code() == CURLY_L) depth++;
+            else if (peek().code() == CURLY_R && !depth--) break;
+        }
+        return node(NodeKind::ERROR, at);
+    }
 
+    switch (peek().code()) {
+        case CURLY_L:
+            return parse_block();
+
+        case FUNC:
+            return parse_func();
+
+        case IF: {
+            consume();
+            std::uint32_t at = last;
+            std::size_t mark = scratch.size();
+            expect(PARAN_L, DiagCode::EXPECTED_HEADER, IF);
+            scratch.push_back(parse_expression());
+            expect(PARAN_R, DiagCode::UNCLOSED_HEADER, IF);
+            scratch.push_back(parse_statement());
+            if (accept(ELSE)) scratch.push_back(parse_statement());
+            return list(NodeKind::IF, at, mark);
         }
+
+        case WHILE: {
+            consume();
+            std::uint32_t at = last;
+            expect(PARAN_L, DiagCode::EXPECTED_HEADER, WHILE);
+            std::uint32_t cond = parse_expression();
+            expect(PARAN_R, DiagCode::UNCLOSED_HEADER, WHILE);
+            std::uint32_t body = parse_statement();
+            return node(NodeKind::WHILE, at, cond, body);
+        }
+
+        case FOR: {
+            consume();
+            std::uint32_t at = last;
+            std::size_t mark = scratch.size();
+            expect(PARAN_L, DiagCode::EXPECTED_HEADER, FOR);
+            parse_items(PARAN_R, DiagCode::UNCLOSED_HEADER, FOR);
+            scratch.push_back(parse_statement());
+            return list(NodeKind::FOR, at, mark);
+        }
+
+        case RET: {
+            consume();
+            std::uint32_t at = last;
+            std::uint32_t value = NO_NODE;
+            if (peek().code() != SEMI) value = parse_expression();
+            expect(SEMI, DiagCode::EXPECTED_SEMI, RET);
+            return node(NodeKind::RET, at, value);
+        }
+
+        case BREAK:
+        case CONTINUE: {
+            TokenCode code = consume().code();
+            std::uint32_t at = last;
+            expect(SEMI, DiagCode::EXPECTED_SEMI, code);
+            return node(code == BREAK ? NodeKind::BREAK : NodeKind::CONTINUE, at);
+        }
+
+        case GET: {
+            consume();
+            std::uint32_t at = last;
+            std::uint32_t module = parse_expression();
+            expect(SEMI, DiagCode::EXPECTED_SEMI, GET);
+            return node(NodeKind::GET, at, module);
+        }
+
+        case SEMI: // empty statement
+            consume();
+            return list(NodeKind::BLOCK, last, scratch.size());
+
+        default: {
+            std::uint32_t at = position();
+            std::uint32_t first = parse_expression();
+            if (peek().code() != COMMA) {
+                expect(SEMI, DiagCode::EXPECTED_SEMI_EXPRESSION);
+                return first;
+            }
+
+            // a = 1, b = 2;
+            std::size_t mark = scratch.size();
+            scratch.push_back(first);
+            while (accept(COMMA)) scratch.push_back(parse_expression());
+            expect(SEMI, DiagCode::EXPECTED_SEMI_EXPRESSION);
+            return list(NodeKind::SEQ, at, mark);
+        }
+    }
+}
+
+std::uint32_t Parser::parse_file(TokenRange range) {
+    cursor = first + range.begin;
+    stop = first + range.end;
+    file_first = (std::uint32_t)range.begin;
+    panic = false;
+    std::size_t mark = scratch.size();
+    while (peek().code() != TokenCode::_EOF) {
+        std::uint32_t from = position();
+        if (peek().code() == TokenCode::CURLY_R) {
+            error(DiagCode::UNMATCHED_CLOSE, from);
+            consume();
+        } else {
+            scratch.push_back(parse_statement());
+        }
+        if (panic) synchronize(from);
     }
+    return list(NodeKind::SOURCE, (std::uint32_t)range.begin, mark);
 }
 
-Parser::Parser(LexOutput lex_output)
-    :   lex(lex_output),
-        arena(Arena::create(1024)),
-        type_registry({
-            { "float" , Type{TypeKind::_float } },
-            { "string", Type{TypeKind::_string} },
-            { "bool"  , Type{TypeKind::_bool  } },
-        })
-        {}
-
-        */
\ No newline at end of file
+std::uint32_t Parser::parse_whole() {
+    std::size_t mark = scratch.size();
+    for (file = 0; file < lex.files().size(); file++) scratch.push_back(parse_file(lex.files()[file]));
+    ast.root_node = list(NodeKind::PROGRAM, 0, mark);
+    return ast.root_node;
+}
+
+Ast parse(const LexOutput& lex, Diagnostics& diags, std::size_t max_depth) {
+    Ast ast;
+    parse(ast, lex, diags, max_depth);
+    return ast;
+}
+
+bool parse(Ast& into, const LexOutput& lex, Diagnostics& diags, std::size_t max_depth) {
+    into.reset();
+    std::size_t before = diags.size();
+    Parser parser(lex, into, diags, max_depth);
+    parser.parse_whole();
+    return diags.size() == before;
+}
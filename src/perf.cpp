@@ -0,0 +1,103 @@
+#include <lang/perf.hpp>
+
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+
+struct CounterConfig { std::uint32_t type; std::uint64_t config; };
+
+#define CACHE_MISS(cache) (cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const CounterConfig configs[PerfCounters::COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+};
+
+#undef CACHE_MISS
+
+PerfCounters::PerfCounters() {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = configs[i].type;
+        attr.config = configs[i].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] < 0 && !error) error = errno;
+        values[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds) if (fd >= 0) close(fd);
+}
+
+void PerfCounters::start() noexcept {
+    for (int fd : fds) {
+        if (fd < 0) continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void PerfCounters::stop() noexcept {
+    for (int fd : fds) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        values[i] = -1;
+        // value, time enabled, time running
+        std::uint64_t read_out[3];
+        if (fds[i] < 0 || read(fds[i], read_out, sizeof(read_out)) != sizeof(read_out)) continue;
+        // counters share the pmu when there are too many, scale up to the full time
+        if (!read_out[2]) continue;
+        values[i] = (std::int64_t)((double)read_out[0] * read_out[1] / read_out[2]);
+    }
+}
+
+const char* PerfCounters::why() const noexcept {
+    if (!error) return "";
+    if (error == EACCES || error == EPERM) return "not permitted, see /proc/sys/kernel/perf_event_paranoid";
+    if (error == ENOENT || error == EOPNOTSUPP) return "not supported by this cpu";
+    if (error == ENOSYS) return "not supported by this kernel";
+    return std::strerror(error);
+}
+
+#else
+
+PerfCounters::PerfCounters() {
+    for (int i = 0; i < COUNTER_COUNT; i++) { fds[i] = -1; values[i] = -1; }
+    error = -1;
+}
+PerfCounters::~PerfCounters() {}
+void PerfCounters::start() noexcept {}
+void PerfCounters::stop() noexcept {}
+const char* PerfCounters::why() const noexcept { return "only available on linux"; }
+
+#endif
+
+bool PerfCounters::available() const noexcept {
+    for (int fd : fds) if (fd >= 0) return true;
+    return false;
+}
+
+const char* PerfCounters::name(Counter counter) noexcept {
+    static const char* const names[COUNTER_COUNT] = { "cycles", "instructions", "branch misses", "L1d misses", "LLC misses" };
+    return names[counter];
+}
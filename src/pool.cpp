@@ -0,0 +1,97 @@
+#include <lang/pool.hpp>
+
+#include <mutex>
+
+namespace block_cache {
+
+// one singly linked free-list per block size, the link lives in the block
+struct Bucket {
+    std::size_t bytes = 0;
+    void* head = nullptr;
+};
+
+#define BLOCK_CACHE_BUCKETS 64
+
+static std::mutex lock;
+static Bucket buckets[BLOCK_CACHE_BUCKETS];
+static std::size_t held = 0, limit = 0;
+static bool on = false;
+
+static void* system_alloc(std::size_t bytes) { return ::operator new(bytes, std::align_val_t(POOL_BLOCK_ALIGN)); }
+static void system_free(void* block) noexcept { ::operator delete(block, std::align_val_t(POOL_BLOCK_ALIGN)); }
+
+// the bucket for bytes, a new one if make is set and there's room
+static Bucket* find(std::size_t bytes, bool make) noexcept {
+    for (Bucket& b : buckets) {
+        if (b.bytes == bytes) return &b;
+        if (!b.bytes) {
+            if (!make) return nullptr;
+            b.bytes = bytes;
+            return &b;
+        }
+    }
+    return nullptr;
+}
+
+void enable(std::size_t max_bytes) {
+    std::lock_guard guard(lock);
+    on = true;
+    limit = max_bytes;
+}
+
+void disable() {
+    std::lock_guard guard(lock);
+    on = false;
+    for (Bucket& b : buckets) {
+        while (b.head) {
+            void* next = *(void**)b.head;
+            system_free(b.head);
+            b.head = next;
+        }
+        b.bytes = 0;
+    }
+    held = 0;
+}
+
+bool enabled() noexcept {
+    std::lock_guard guard(lock);
+    return on;
+}
+
+std::size_t cached_bytes() noexcept {
+    std::lock_guard guard(lock);
+    return held;
+}
+
+void* acquire(std::size_t bytes, bool& reused) {
+    {
+        std::lock_guard guard(lock);
+        Bucket* b = on ? find(bytes, false) : nullptr;
+        if (b && b->head) {
+            void* block = b->head;
+            b->head = *(void**)block;
+            held -= bytes;
+            reused = true;
+            return block;
+        }
+    }
+    reused = false;
+    return system_alloc(bytes);
+}
+
+void release(void* block, std::size_t bytes) noexcept {
+    if (!block) return;
+    {
+        std::lock_guard guard(lock);
+        Bucket* b = on && held + bytes <= limit ? find(bytes, true) : nullptr;
+        if (b) {
+            *(void**)block = b->head;
+            b->head = block;
+            held += bytes;
+            return;
+        }
+    }
+    system_free(block);
+}
+
+}
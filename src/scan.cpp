@@ -0,0 +1,247 @@
+#include <lang/scan.hpp>
+
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scan {
+
+// scalar fallback, also the reference the simd kernels have to agree with
+
+static void classify_scalar(const char* block, Masks& out) {
+    out = {};
+    for (int i = 0; i < 64; i++) {
+        unsigned char cls = table[(unsigned char)block[i]];
+        std::uint64_t bit = 1ull << i;
+        if (cls & SPACE) out.space |= bit;
+        if (cls & IDENT) out.ident |= bit;
+        if (cls & DIGIT) out.digit |= bit;
+        if (cls & QUOTE) out.quote |= bit;
+        if (cls & PUNCT) out.punct |= bit;
+    }
+}
+
+static const char* skip_space_scalar(const char* p) {
+    while (table[(unsigned char)*p] & SPACE) ++p;
+    return p;
+}
+
+static const char* find_byte_scalar(const char* p, char c) {
+    while (*p && *p != c) ++p;
+    return p;
+}
+
+static std::size_t line_starts_scalar(const char* p, const char* end, std::uint32_t* out) {
+    std::size_t n = 0;
+    for (const char* c = p; c < end; c++) {
+        if (*c != '\n') continue;
+        if (out) out[n] = (std::uint32_t)(c + 1 - p);
+        n++;
+    }
+    return n;
+}
+
+#ifdef SCAN_X86
+
+// every kernel walks aligned 64 byte blocks, so a load never crosses into the
+// next page. the first block masks off the bytes before p
+#define SCAN_BLOCKS(MASK64)                                                   \
+    const char* base = (const char*)((std::uintptr_t)p & ~(std::uintptr_t)63); \
+    std::uint64_t live = ~0ull << (p - base);                                 \
+    for (;;) {                                                                \
+        std::uint64_t hit = (MASK64) & live;                                  \
+        if (hit) return base + __builtin_ctzll(hit);                          \
+        base += 64; live = ~0ull;                                             \
+    }
+
+// same walk over [p, end), but every hit is taken: counted with a popcount,
+// or written out bit by bit
+#define LINE_BLOCKS(MASK64)                                                   \
+    const char* base = (const char*)((std::uintptr_t)p & ~(std::uintptr_t)63); \
+    std::uint64_t live = ~0ull << (p - base);                                 \
+    std::size_t n = 0;                                                        \
+    for (; base < end; base += 64, live = ~0ull) {                            \
+        if (end - base < 64) live &= ~0ull >> (64 - (end - base));            \
+        std::uint64_t hit = (MASK64) & live;                                  \
+        if (!out) { n += __builtin_popcountll(hit); continue; }               \
+        for (; hit; hit &= hit - 1) out[n++] = (std::uint32_t)(base + __builtin_ctzll(hit) + 1 - p); \
+    }                                                                         \
+    return n;
+
+// -- sse2, 4 x 16 bytes per block --
+
+#define TARGET_SSE2 __attribute__((target("sse2")))
+
+TARGET_SSE2 static inline __m128i sse_le(__m128i x, char lo, char span) {
+    // unsigned (x - lo) <= span
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(span)), t);
+}
+
+TARGET_SSE2 static inline __m128i sse_space(__m128i x) {
+    return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), sse_le(x, '\t', '\r' - '\t'));
+}
+
+TARGET_SSE2 static inline __m128i sse_ident(__m128i x) {
+    __m128i alpha = sse_le(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z' - 'a');
+    __m128i digit = sse_le(x, '0', 9);
+    return _mm_or_si128(_mm_or_si128(alpha, digit), _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+
+TARGET_SSE2 static inline __m128i sse_byte(__m128i x, __m128i c) {
+    return _mm_or_si128(_mm_cmpeq_epi8(x, c), _mm_cmpeq_epi8(x, _mm_setzero_si128()));
+}
+
+// the kernels that look for a byte take it as vc
+#define SSE_MASK64(NAME, EXPR, ...)                                           \
+    TARGET_SSE2 static inline std::uint64_t NAME(const char* base __VA_ARGS__) { \
+        std::uint64_t m = 0;                                                  \
+        for (int i = 0; i < 4; i++) {                                         \
+            __m128i x = _mm_load_si128((const __m128i*)(base + 16*i));        \
+            m |= (std::uint64_t)(unsigned)_mm_movemask_epi8(EXPR) << (16*i);  \
+        }                                                                     \
+        return m;                                                             \
+    }
+
+SSE_MASK64(sse_space64, sse_space(x))
+SSE_MASK64(sse_byte64, sse_byte(x, vc), , __m128i vc)
+SSE_MASK64(sse_eq64, _mm_cmpeq_epi8(x, vc), , __m128i vc)
+#undef SSE_MASK64
+
+TARGET_SSE2 static void classify_sse2(const char* block, Masks& out) {
+    out = {};
+    for (int i = 0; i < 4; i++) {
+        __m128i x = _mm_load_si128((const __m128i*)(block + 16*i));
+        __m128i ident = sse_ident(x);
+        __m128i quote = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\'')));
+        // printable, '!' to '~', and neither of the two above
+        __m128i punct = _mm_andnot_si128(_mm_or_si128(ident, quote), sse_le(x, '!', '~' - '!'));
+        out.space |= (std::uint64_t)(unsigned)_mm_movemask_epi8(sse_space(x)) << (16*i);
+        out.ident |= (std::uint64_t)(unsigned)_mm_movemask_epi8(ident) << (16*i);
+        out.digit |= (std::uint64_t)(unsigned)_mm_movemask_epi8(sse_le(x, '0', 9)) << (16*i);
+        out.quote |= (std::uint64_t)(unsigned)_mm_movemask_epi8(quote) << (16*i);
+        out.punct |= (std::uint64_t)(unsigned)_mm_movemask_epi8(punct) << (16*i);
+    }
+}
+
+TARGET_SSE2 static const char* skip_space_sse2(const char* p) {
+    SCAN_BLOCKS(~sse_space64(base))
+}
+
+TARGET_SSE2 static const char* find_byte_sse2(const char* p, char c) {
+    __m128i vc = _mm_set1_epi8(c);
+    SCAN_BLOCKS(sse_byte64(base, vc))
+}
+
+TARGET_SSE2 static std::size_t line_starts_sse2(const char* p, const char* end, std::uint32_t* out) {
+    __m128i vc = _mm_set1_epi8('\n');
+    LINE_BLOCKS(sse_eq64(base, vc))
+}
+
+// -- avx2, 2 x 32 bytes per block --
+
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+TARGET_AVX2 static inline __m256i avx_le(__m256i x, char lo, char span) {
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(span)), t);
+}
+
+TARGET_AVX2 static inline __m256i avx_space(__m256i x) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), avx_le(x, '\t', '\r' - '\t'));
+}
+
+TARGET_AVX2 static inline __m256i avx_ident(__m256i x) {
+    __m256i alpha = avx_le(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z' - 'a');
+    __m256i digit = avx_le(x, '0', 9);
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+}
+
+TARGET_AVX2 static inline __m256i avx_byte(__m256i x, __m256i c) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(x, c), _mm256_cmpeq_epi8(x, _mm256_setzero_si256()));
+}
+
+#define AVX_MASK64(NAME, EXPR, ...)                                           \
+    TARGET_AVX2 static inline std::uint64_t NAME(const char* base __VA_ARGS__) { \
+        __m256i x = _mm256_load_si256((const __m256i*)base);                  \
+        std::uint64_t lo = (unsigned)_mm256_movemask_epi8(EXPR);              \
+        x = _mm256_load_si256((const __m256i*)(base + 32));                   \
+        return lo | (std::uint64_t)(unsigned)_mm256_movemask_epi8(EXPR) << 32; \
+    }
+
+AVX_MASK64(avx_space64, avx_space(x))
+AVX_MASK64(avx_byte64, avx_byte(x, vc), , __m256i vc)
+AVX_MASK64(avx_eq64, _mm256_cmpeq_epi8(x, vc), , __m256i vc)
+#undef AVX_MASK64
+
+TARGET_AVX2 static void classify_avx2(const char* block, Masks& out) {
+    out = {};
+    for (int i = 0; i < 2; i++) {
+        __m256i x = _mm256_load_si256((const __m256i*)(block + 32*i));
+        __m256i ident = avx_ident(x);
+        __m256i quote = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')));
+        __m256i punct = _mm256_andnot_si256(_mm256_or_si256(ident, quote), avx_le(x, '!', '~' - '!'));
+        out.space |= (std::uint64_t)(unsigned)_mm256_movemask_epi8(avx_space(x)) << (32*i);
+        out.ident |= (std::uint64_t)(unsigned)_mm256_movemask_epi8(ident) << (32*i);
+        out.digit |= (std::uint64_t)(unsigned)_mm256_movemask_epi8(avx_le(x, '0', 9)) << (32*i);
+        out.quote |= (std::uint64_t)(unsigned)_mm256_movemask_epi8(quote) << (32*i);
+        out.punct |= (std::uint64_t)(unsigned)_mm256_movemask_epi8(punct) << (32*i);
+    }
+}
+
+TARGET_AVX2 static const char* skip_space_avx2(const char* p) {
+    SCAN_BLOCKS(~avx_space64(base))
+}
+
+TARGET_AVX2 static const char* find_byte_avx2(const char* p, char c) {
+    __m256i vc = _mm256_set1_epi8(c);
+    SCAN_BLOCKS(avx_byte64(base, vc))
+}
+
+TARGET_AVX2 static std::size_t line_starts_avx2(const char* p, const char* end, std::uint32_t* out) {
+    __m256i vc = _mm256_set1_epi8('\n');
+    LINE_BLOCKS(avx_eq64(base, vc))
+}
+
+#undef SCAN_BLOCKS
+#undef LINE_BLOCKS
+#undef TARGET_SSE2
+#undef TARGET_AVX2
+
+#endif // SCAN_X86
+
+Level detect() noexcept {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Level::AVX2;
+    if (__builtin_cpu_supports("sse2")) return Level::SSE2;
+#endif
+    return Level::SCALAR;
+}
+
+static Kernels make_kernels(Level level) noexcept {
+    switch (level) {
+#ifdef SCAN_X86
+        case Level::AVX2: return { classify_avx2, skip_space_avx2, find_byte_avx2, line_starts_avx2 };
+        case Level::SSE2: return { classify_sse2, skip_space_sse2, find_byte_sse2, line_starts_sse2 };
+#endif
+        default: return { classify_scalar, skip_space_scalar, find_byte_scalar, line_starts_scalar };
+    }
+}
+
+static Level current = detect();
+Kernels kernels = make_kernels(current);
+
+Level level() noexcept { return current; }
+
+void select(Level level) noexcept {
+    Level best = detect();
+    if (level > best) level = best;
+    current = level;
+    kernels = make_kernels(level);
+}
+
+}
@@ -0,0 +1,101 @@
+#include <lang/source.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SOURCE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static char* padded_alloc(std::size_t size) {
+    char* buf = new char[size + SOURCE_PADDING];
+    std::memset(buf + size, 0, SOURCE_PADDING);
+    return buf;
+}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept {
+    if (this == &other) return *this;
+    this->~SourceBuffer();
+    _data = other._data; _size = other._size; _mapped = other._mapped; _loaded = other._loaded;
+    other._data = nullptr; other._size = other._mapped = 0; other._loaded = false;
+    return *this;
+}
+
+SourceBuffer::~SourceBuffer() {
+#ifdef SOURCE_MMAP
+    if (_mapped) { munmap((void*)_data, _mapped); return; }
+#endif
+    delete[] _data;
+}
+
+SourceBuffer SourceBuffer::copy(const char* text, std::size_t size) {
+    SourceBuffer buf;
+    char* data = padded_alloc(size);
+    std::memcpy(data, text, size);
+    buf._data = data; buf._size = size; buf._loaded = true;
+    return buf;
+}
+
+// reads until eof, for streams that can't be mapped or sized up front
+static SourceBuffer read_stream(std::FILE* f) {
+    std::size_t size = 0, capacity = 1 << 16;
+    char* data = new char[capacity];
+    for (std::size_t n; (n = std::fread(data + size, 1, capacity - size, f)) > 0;) {
+        size += n;
+        if (size < capacity) continue;
+        char* bigger = new char[capacity <<= 1];
+        std::memcpy(bigger, data, size);
+        delete[] data;
+        data = bigger;
+    }
+    SourceBuffer buf = SourceBuffer::copy(data, size);
+    delete[] data;
+    return buf;
+}
+
+SourceBuffer SourceBuffer::load(const char* path) {
+    if (path[0] == '-' && !path[1]) return read_stream(stdin);
+
+#ifdef SOURCE_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return {};
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        std::size_t size = (std::size_t)st.st_size;
+        std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+        std::size_t length = (size + SOURCE_PADDING + page - 1) & ~(page - 1);
+
+        // reserve zeroed pages for file + padding, then map the file over the
+        // front. the kernel zero fills the rest of the file's last page
+        void* region = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region != MAP_FAILED && (!size || mmap(region, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED)) {
+            close(fd);
+            SourceBuffer buf;
+            buf._data = (const char*)region; buf._size = size; buf._mapped = length; buf._loaded = true;
+            return buf;
+        }
+        if (region != MAP_FAILED) munmap(region, length);
+    }
+    close(fd);
+#endif
+
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) return {};
+    SourceBuffer buf;
+    long size = std::fseek(f, 0, SEEK_END) == 0 ? std::ftell(f) : -1;
+    if (size >= 0) {
+        std::rewind(f);
+        char* data = padded_alloc((std::size_t)size);
+        std::size_t read = std::fread(data, 1, (std::size_t)size, f);
+        std::memset(data + read, 0, (std::size_t)size - read);
+        buf._data = data; buf._size = read; buf._loaded = true;
+    } else {
+        buf = read_stream(f);
+    }
+    std::fclose(f);
+    return buf;
+}
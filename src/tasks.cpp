@@ -0,0 +1,76 @@
+#include <lang/tasks.hpp>
+
+#include <thread>
+#include <vector>
+#include <lang/trace.hpp>
+
+// which worker of the running pool this thread is
+static thread_local unsigned int current = 0;
+
+TaskPool::TaskPool(int jobs)
+    : queues(new Queue[jobs > 1 ? jobs : 1]), workers(jobs > 1 ? (unsigned int)jobs : 1) {}
+
+void TaskPool::spawn(std::uint32_t item) {
+    // counted before it's visible, pending can't reach 0 with it queued
+    pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        Queue& queue = queues[current < workers ? current : 0];
+        std::lock_guard guard(queue.lock);
+        queue.items.push_back(item);
+    }
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_one();
+}
+
+bool TaskPool::take(unsigned int self, std::uint32_t& item) {
+    {
+        Queue& own = queues[self];
+        std::lock_guard guard(own.lock);
+        if (!own.items.empty()) {
+            item = own.items.back();
+            own.items.pop_back();
+            return true;
+        }
+    }
+    for (unsigned int i = 1; i < workers; i++) {
+        Queue& victim = queues[(self + i) % workers];
+        std::lock_guard guard(victim.lock);
+        if (!victim.items.empty()) {
+            item = victim.items.front();
+            victim.items.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::work(unsigned int self) {
+    current = self;
+    for (;;) {
+        // read before looking, a spawn after the look changes it and the wait falls through
+        std::uint32_t seen = signal.load(std::memory_order_acquire);
+        std::uint32_t item;
+        if (take(self, item)) {
+            handler(item);
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                signal.fetch_add(1, std::memory_order_release);
+                signal.notify_all();
+            }
+            continue;
+        }
+        if (!pending.load(std::memory_order_acquire)) break;
+        signal.wait(seen, std::memory_order_acquire);
+    }
+    current = 0;
+}
+
+void TaskPool::run(std::function<void(std::uint32_t)> handler) {
+    this->handler = std::move(handler);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < workers; i++) {
+        threads.emplace_back([this, i] { TRACE_THREAD("task worker"); work(i); });
+    }
+    work(0);
+    for (std::thread& t : threads) t.join();
+    this->handler = nullptr;
+}
@@ -0,0 +1,129 @@
+#include <lang/trace.hpp>
+
+#if DOYT_TRACE
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include <lang/pool.hpp>
+
+namespace trace {
+
+std::atomic<bool> recording = false;
+
+struct Event {
+    const char* name;
+    const char* detail;
+    std::int64_t arg; // the counter's value for 'C', whose series is in detail
+    std::int64_t ns;
+    char phase;       // 'B', 'E' or 'C'
+};
+
+struct ThreadBuffer {
+    int tid = 0;
+    const char* name = nullptr;
+    Pool<Event> events;
+};
+
+// only taken when a thread records its first event, and by write()
+static std::mutex lock;
+// never freed, worker threads are gone by the time the trace is written
+static std::vector<ThreadBuffer*> buffers;
+static thread_local ThreadBuffer* local = nullptr;
+static std::chrono::steady_clock::time_point zero;
+
+static ThreadBuffer& buffer() {
+    if (!local) {
+        std::lock_guard guard(lock);
+        local = new ThreadBuffer();
+        buffers.push_back(local);
+        local->tid = (int)buffers.size();
+    }
+    return *local;
+}
+
+static std::int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - zero).count();
+}
+
+void start() {
+    zero = std::chrono::steady_clock::now();
+    recording = true;
+    thread_name("main");
+}
+
+void begin(const char* name, const char* detail, std::int64_t arg) {
+    buffer().events.insert({ name, detail, arg, now(), 'B' });
+}
+
+void end() {
+    buffer().events.insert({ nullptr, nullptr, -1, now(), 'E' });
+}
+
+void counter(const char* name, const char* series, std::int64_t value) {
+    buffer().events.insert({ name, series, value, now(), 'C' });
+}
+
+void thread_name(const char* name) {
+    buffer().name = name;
+}
+
+static void write_string(std::FILE* f, const char* text) {
+    std::fputc('"', f);
+    for (; *text; ++text) {
+        unsigned char c = *text;
+        if (c == '"' || c == '\\') std::fprintf(f, "\\%c", c);
+        else if (c < 0x20) std::fprintf(f, "\\u%04x", c);
+        else std::fputc(c, f);
+    }
+    std::fputc('"', f);
+}
+
+bool write(const char* path) {
+    recording = false;
+    std::FILE* f = std::fopen(path, "w");
+    if (!f) return false;
+
+    std::lock_guard guard(lock);
+    std::fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    bool first = true;
+    auto next = [&] { std::fprintf(f, first ? "\n" : ",\n"); first = false; };
+
+    for (ThreadBuffer* buf : buffers) {
+        if (buf->name) {
+            next();
+            std::fprintf(f, "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ", buf->tid);
+            write_string(f, buf->name);
+            std::fprintf(f, "}}");
+        }
+
+        for (const Event& e : buf->events) {
+            next();
+            // chrome wants microseconds
+            std::fprintf(f, "{\"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f", e.phase, buf->tid, e.ns / 1000.0);
+            if (e.phase == 'E') { std::fprintf(f, "}"); continue; }
+
+            std::fprintf(f, ", \"name\": ");
+            write_string(f, e.name);
+            if (e.phase == 'C') {
+                std::fprintf(f, ", \"args\": {");
+                write_string(f, e.detail);
+                std::fprintf(f, ": %lld}}", (long long)e.arg);
+                continue;
+            }
+            std::fprintf(f, ", \"args\": {");
+            if (e.detail) { std::fprintf(f, "\"detail\": "); write_string(f, e.detail); }
+            if (e.arg >= 0) std::fprintf(f, "%s\"index\": %lld", e.detail ? ", " : "", (long long)e.arg);
+            std::fprintf(f, "}}");
+        }
+    }
+
+    std::fprintf(f, "\n]}\n");
+    return std::fclose(f) == 0;
+}
+
+}
+
+#endif
@@ -0,0 +1,358 @@
+#include <lang/vm.hpp>
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <lang/trace.hpp>
+
+#if DOYT_COMPUTED_GOTO && (defined(__GNUC__) || defined(__clang__))
+#define VM_GOTO 1
+#else
+#define VM_GOTO 0
+#endif
+
+// natives, as globals of these names
+static constexpr const char* native_names[] = { "print", "number", "clock" };
+enum Native : std::uint32_t { PRINT, NUMBER, CLOCK };
+
+static inline bool is_number(const Value& v) { return (std::uint8_t)((std::uint8_t)v.type - (std::uint8_t)ValueType::INT) <= 1; }
+static inline double as_double(const Value& v) { return v.type == ValueType::INT ? (double)v.i : v.f; }
+static inline bool falsy(const Value& v) {
+    switch (v.type) {
+        case ValueType::NIL: return true;
+        case ValueType::BOOL: return !v.b;
+        case ValueType::INT: return !v.i;
+        case ValueType::FLOAT: return v.f == 0;
+        default: return false;
+    }
+}
+
+// ints wrap around instead of overflowing
+static inline std::int64_t wrap_add(std::int64_t a, std::int64_t b) { return (std::int64_t)((std::uint64_t)a + (std::uint64_t)b); }
+static inline std::int64_t wrap_sub(std::int64_t a, std::int64_t b) { return (std::int64_t)((std::uint64_t)a - (std::uint64_t)b); }
+static inline std::int64_t wrap_mul(std::int64_t a, std::int64_t b) { return (std::int64_t)((std::uint64_t)a * (std::uint64_t)b); }
+
+static inline bool add_overflows(std::int64_t a, std::int64_t b, std::int64_t& sum) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_add_overflow(a, b, &sum);
+#else
+    sum = wrap_add(a, b);
+    return (b > 0 && sum < a) || (b < 0 && sum > a);
+#endif
+}
+
+static bool equal(const Value& x, const Value& y) {
+    if (x.type != y.type) return is_number(x) && is_number(y) && as_double(x) == as_double(y);
+    switch (x.type) {
+        case ValueType::NIL: return true;
+        case ValueType::BOOL: return x.b == y.b;
+        case ValueType::INT: return x.i == y.i;
+        case ValueType::FLOAT: return x.f == y.f;
+        default: return x.index == y.index;
+    }
+}
+
+VM::VM(const Bytecode& code, const LexOutput& lex, Diagnostics& diags, std::ostream& out)
+    : code(code), lex(lex), diags(diags), out(out),
+      stack((Value*)::operator new(sizeof(Value) * VM_STACK_SIZE)),
+      frames(std::make_unique_for_overwrite<Frame[]>(VM_MAX_DEPTH)), globals(code.globals.size()) {
+    for (std::size_t slot = 0; slot < code.globals.size(); slot++) {
+        for (std::uint32_t n = 0; n < std::size(native_names); n++) {
+            if (code.globals[slot] == native_names[n]) globals[slot] = Value::of(ValueType::NATIVE, n);
+        }
+    }
+}
+
+Value VM::global(std::string_view name) const {
+    for (std::size_t slot = 0; slot < code.globals.size(); slot++) {
+        if (code.globals[slot] == name) return globals[slot];
+    }
+    return {};
+}
+
+std::ostream& VM::print(std::ostream& stream, const Value& value) const {
+    switch (value.type) {
+        case ValueType::NIL: return stream << "nil";
+        case ValueType::BOOL: return stream << (value.b ? "true" : "false");
+        case ValueType::INT: return stream << value.i;
+        case ValueType::FLOAT: {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.14g", value.f);
+            return stream << text;
+        }
+        case ValueType::STRING: return stream << code.strings[value.index];
+        case ValueType::FUNCTION: return stream << "func " << code.functions[value.index].name;
+        case ValueType::NATIVE: return stream << "native " << native_names[value.index];
+    }
+    return stream;
+}
+
+bool VM::fail(const Function* fn, const Instr* at, DiagCode diag, std::uint32_t arg0, std::uint32_t arg1) {
+    std::uint32_t token = fn->tokens[at - fn->code.data()];
+    diags.report(diag, lex.file_of(token), lex.offset(token), arg0, arg1);
+    return false;
+}
+
+bool VM::native(std::uint32_t index, const Value* args, std::uint32_t count, Value& result, DiagCode& error, std::uint32_t& arg) {
+    switch (index) {
+        case PRINT:
+            for (std::uint32_t i = 0; i < count; i++) print(out << (i ? " " : ""), args[i]);
+            out << "\n";
+            result = Value();
+            return true;
+
+        case NUMBER: {
+            if (count != 1) {
+                error = DiagCode::ARGUMENT_COUNT;
+                arg = 1;
+                return false;
+            }
+            Value value = args[0];
+            if (value.type == ValueType::BOOL || value.type == ValueType::NIL) {
+                result = Value::integer(value.type == ValueType::BOOL && value.b);
+                return true;
+            }
+            if (value.type == ValueType::STRING) {
+                // an int if it's all digits, a double otherwise, 0 if neither
+                const std::string& text = code.strings[value.index];
+                const char* end = text.data() + text.size();
+                std::int64_t i = 0;
+                double f = 0;
+                if (auto [at, status] = std::from_chars(text.data(), end, i); status == std::errc() && at == end) result = Value::integer(i);
+                else if (std::from_chars(text.data(), end, f).ec == std::errc()) result = Value::number(f);
+                else result = Value::integer(0);
+                return true;
+            }
+            if (!is_number(value)) {
+                error = DiagCode::BAD_OPERANDS;
+                return false;
+            }
+            result = value;
+            return true;
+        }
+
+        case CLOCK:
+            result = Value::number(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count());
+            return true;
+    }
+    error = DiagCode::NOT_CALLABLE;
+    return false;
+}
+
+bool VM::run() {
+    TRACE_SPAN("run");
+    const Function* fn = &code.functions[0];
+    Value* base = stack.get();
+    Value* const stack_end = stack.get() + VM_STACK_SIZE;
+    if (fn->registers > VM_STACK_SIZE) return false;
+    for (std::uint32_t r = 0; r < fn->registers; r++) base[r] = Value();
+    const Instr* pc = fn->code.data();
+    const Value* K = fn->constants.data();
+    std::uint32_t depth = 0;
+    Instr i;
+
+    // what failed, for the one exit that reports it
+    DiagCode error = DiagCode::BAD_OPERANDS;
+    std::uint32_t arg0 = 0, arg1 = 0;
+
+#define R(x) base[x]
+#define FAIL(code, a0, a1) do { error = DiagCode::code; arg0 = a0; arg1 = a1; goto failed; } while (0)
+
+#if VM_GOTO
+    // a handler jumps straight to the next one, no bounds check, no shared branch
+    static void* const labels[] = {
+#define LABEL(op, name) &&op_##op,
+        DOYT_OPCODES(LABEL)
+#undef LABEL
+    };
+#define OP(op) op_##op:
+#define NEXT() do { i = *pc++; goto *labels[(std::size_t)i.op()]; } while (0)
+    NEXT();
+#else
+#define OP(op) case Opcode::op:
+#define NEXT() continue
+    for (;;) {
+        i = *pc++;
+        switch (i.op()) {
+#endif
+
+    OP(MOVE) R(i.a()) = R(i.b()); NEXT();
+    OP(LOADK) R(i.a()) = K[i.bx()]; NEXT();
+    OP(LOADI) R(i.a()) = Value::integer(i.sbx()); NEXT();
+    OP(LOADNIL) R(i.a()) = Value(); NEXT();
+    OP(LOADBOOL) R(i.a()) = Value::boolean(i.b()); NEXT();
+    OP(GETGLOBAL) R(i.a()) = globals[i.bx()]; NEXT();
+    OP(SETGLOBAL) globals[i.bx()] = R(i.a()); NEXT();
+
+    // ints if both are, doubles if both are numbers
+#define ARITH(op, int_value, float_value) OP(op) { \
+        const Value& x = R(i.b()); \
+        const Value& y = R(i.c()); \
+        if (x.type == ValueType::INT && y.type == ValueType::INT) { \
+            std::int64_t a = x.i, b = y.i; \
+            R(i.a()) = Value::integer(int_value); \
+        } else if (is_number(x) && is_number(y)) { \
+            double a = as_double(x), b = as_double(y); \
+            R(i.a()) = Value::number(float_value); \
+        } else FAIL(BAD_OPERANDS, 0, 0); \
+        NEXT(); \
+    }
+    ARITH(ADD, wrap_add(a, b), a + b)
+    ARITH(SUB, wrap_sub(a, b), a - b)
+    ARITH(MUL, wrap_mul(a, b), a * b)
+#undef ARITH
+
+    OP(DIV) {
+        const Value& x = R(i.b());
+        const Value& y = R(i.c());
+        if (x.type == ValueType::INT && y.type == ValueType::INT) {
+            if (!y.i) FAIL(DIVIDE_BY_ZERO, 0, 0);
+            R(i.a()) = Value::integer(y.i == -1 ? wrap_sub(0, x.i) : x.i / y.i);
+        } else if (is_number(x) && is_number(y)) {
+            R(i.a()) = Value::number(as_double(x) / as_double(y));
+        } else FAIL(BAD_OPERANDS, 0, 0);
+        NEXT();
+    }
+
+#define SHIFT(op, shifted) OP(op) { \
+        const Value& x = R(i.b()); \
+        const Value& y = R(i.c()); \
+        if (x.type != ValueType::INT || y.type != ValueType::INT) FAIL(BAD_OPERANDS, 0, 0); \
+        R(i.a()) = Value::integer(shifted); \
+        NEXT(); \
+    }
+    SHIFT(SHL, (std::int64_t)((std::uint64_t)x.i << (y.i & 63)))
+    SHIFT(SHR, x.i >> (y.i & 63))
+#undef SHIFT
+
+    OP(EQ) R(i.a()) = Value::boolean(equal(R(i.b()), R(i.c()))); NEXT();
+    OP(NEQ) R(i.a()) = Value::boolean(!equal(R(i.b()), R(i.c()))); NEXT();
+
+    // numbers only, ints compared as ints
+#define ORDER(x, y, cmp, result) \
+        bool result; \
+        if (x.type == ValueType::INT && y.type == ValueType::INT) result = x.i cmp y.i; \
+        else if (is_number(x) && is_number(y)) result = as_double(x) cmp as_double(y); \
+        else FAIL(BAD_COMPARE, 0, 0);
+
+    OP(LT) { ORDER(R(i.b()), R(i.c()), <, less) R(i.a()) = Value::boolean(less); NEXT(); }
+    OP(LTEQ) { ORDER(R(i.b()), R(i.c()), <=, less) R(i.a()) = Value::boolean(less); NEXT(); }
+
+    OP(ADDI) {
+        const Value& x = R(i.b());
+        std::int8_t imm = (std::int8_t)i.c();
+        if (x.type == ValueType::INT) R(i.a()) = Value::integer(wrap_add(x.i, imm));
+        else if (x.type == ValueType::FLOAT) R(i.a()) = Value::number(x.f + imm);
+        else FAIL(BAD_OPERANDS, 0, 0);
+        NEXT();
+    }
+
+    OP(NEG) {
+        const Value& x = R(i.b());
+        if (x.type == ValueType::INT) R(i.a()) = Value::integer(wrap_sub(0, x.i));
+        else if (x.type == ValueType::FLOAT) R(i.a()) = Value::number(-x.f);
+        else FAIL(BAD_OPERANDS, 0, 0);
+        NEXT();
+    }
+    OP(NOT) R(i.a()) = Value::boolean(falsy(R(i.b()))); NEXT();
+
+    OP(JMP) pc += i.sbx(); NEXT();
+    OP(JMPF) if (falsy(R(i.a()))) pc += i.sbx(); NEXT();
+    OP(JMPT) if (!falsy(R(i.a()))) pc += i.sbx(); NEXT();
+
+    // the JMP after a compare is read here, not dispatched
+#define BRANCH(taken) pc += (taken) == (bool)i.c() ? 1 + pc->sbx() : 1;
+    OP(JEQ) BRANCH(equal(R(i.a()), R(i.b()))) NEXT();
+    OP(JNEQ) BRANCH(!equal(R(i.a()), R(i.b()))) NEXT();
+    OP(JLT) { ORDER(R(i.a()), R(i.b()), <, less) BRANCH(less) NEXT(); }
+    OP(JLTEQ) { ORDER(R(i.a()), R(i.b()), <=, less) BRANCH(less) NEXT(); }
+#undef BRANCH
+#undef ORDER
+
+    OP(FORPREP) {
+        Value* loop = &R(i.a());
+        if (loop[0].type == ValueType::INT && loop[1].type == ValueType::INT && loop[2].type == ValueType::INT) {
+            if (!loop[2].i) FAIL(BAD_FOR_VALUES, 0, 0);
+            if (loop[2].i > 0 ? loop[0].i > loop[1].i : loop[0].i < loop[1].i) pc += i.sbx();
+        } else if (is_number(loop[0]) && is_number(loop[1]) && is_number(loop[2])) {
+            // all doubles, FORLOOP only looks at the counter's type
+            for (int k = 0; k < 3; k++) loop[k] = Value::number(as_double(loop[k]));
+            if (!(loop[2].f != 0)) FAIL(BAD_FOR_VALUES, 0, 0);
+            if (loop[2].f > 0 ? loop[0].f > loop[1].f : loop[0].f < loop[1].f) pc += i.sbx();
+        } else FAIL(BAD_FOR_VALUES, 0, 0);
+        NEXT();
+    }
+
+    // count, compare and branch back in one
+    OP(FORLOOP) {
+        Value* loop = &R(i.a());
+        if (loop[0].type == ValueType::INT) {
+            std::int64_t next;
+            if (!add_overflows(loop[0].i, loop[2].i, next) && (loop[2].i > 0 ? next <= loop[1].i : next >= loop[1].i)) {
+                loop[0].i = next;
+                pc += i.sbx();
+            }
+        } else {
+            double next = loop[0].f + loop[2].f;
+            if (loop[2].f > 0 ? next <= loop[1].f : next >= loop[1].f) {
+                loop[0].f = next;
+                pc += i.sbx();
+            }
+        }
+        NEXT();
+    }
+
+    OP(CALL) {
+        Value* callee = &R(i.a());
+        std::uint32_t count = i.b();
+        if (callee->type == ValueType::FUNCTION) {
+            const Function* next = &code.functions[callee->index];
+            if (count != next->params) FAIL(ARGUMENT_COUNT, next->params, count);
+            if (depth == VM_MAX_DEPTH || callee + 1 + next->registers > stack_end) FAIL(STACK_OVERFLOW, depth, 0);
+            frames[depth++] = { fn, pc, base };
+            base = callee + 1;
+            for (std::uint32_t r = count; r < next->registers; r++) base[r] = Value();
+            fn = next;
+            pc = fn->code.data();
+            K = fn->constants.data();
+        } else if (callee->type == ValueType::NATIVE) {
+            std::uint32_t expected = 0;
+            if (!native(callee->index, callee + 1, count, *callee, error, expected)) {
+                arg0 = expected;
+                arg1 = count;
+                goto failed;
+            }
+        } else FAIL(NOT_CALLABLE, 0, 0);
+        NEXT();
+    }
+
+    // the result goes where the callee was
+#define RETURN(result) { \
+        Value value = result; \
+        if (!depth) return true; \
+        base[-1] = value; \
+        const Frame& frame = frames[--depth]; \
+        fn = frame.fn; \
+        pc = frame.pc; \
+        base = frame.base; \
+        K = fn->constants.data(); \
+        NEXT(); \
+    }
+    OP(RET) RETURN(R(i.a()))
+    OP(RET0) RETURN(Value())
+#undef RETURN
+
+#if !VM_GOTO
+            case Opcode::_COUNT: break;
+        }
+    }
+#endif
+
+failed:
+    return fail(fn, pc - 1, error, arg0, arg1);
+
+#undef OP
+#undef NEXT
+#undef FAIL
+#undef R
+}